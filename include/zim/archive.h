@@ -28,6 +28,7 @@
 #include <vector>
 #include <memory>
 #include <bitset>
+#include <functional>
 
 
 namespace zim
@@ -322,6 +323,15 @@ namespace zim
        */
       bool check() const;
 
+      /** Check that the zim file is valid (in regard to its checksum).
+       *
+       *  Same as `check()`, but `progress` is regularly called with the
+       *  number of bytes already checked and the number of bytes to check.
+       *
+       *  @return True if the file is valid.
+       */
+      bool check(const std::function<void(size_type, size_type)>& progress) const;
+
       /** Check the integrity of the zim file.
        *
        * Run different type of checks to verify the zim file is valid
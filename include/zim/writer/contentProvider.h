@@ -78,6 +78,47 @@ namespace zim
         virtual Blob feed() = 0;
     };
 
+    /**
+     * `PrefetchableProvider` is an optional interface of the content
+     * providers of slow contents (network, slow disk...).
+     *
+     * `Creator::addItems` fetches the content of the next items in fetch
+     * threads while the previous items are added. For a provider also
+     * implementing this interface, it calls `prefetch` then `ready`. The
+     * content of the other providers is read in memory by the fetch thread
+     * (unless it is too big), except for the providers of libzim which
+     * already have their content at hand.
+     *
+     * A provider implements it by deriving from both `ContentProvider` and
+     * `PrefetchableProvider`.
+     */
+    class PrefetchableProvider {
+      public:
+        virtual ~PrefetchableProvider() = default;
+
+        /**
+         * Fetch the content before it is fed.
+         *
+         * This is called from a fetch thread of the creator, before the
+         * item is added. The provider can fetch its content (or start
+         * fetching it) here, so the fetching of several contents overlaps,
+         * and overlaps with the compression of the clusters.
+         * `prefetch` may block. It may be called concurrently on different
+         * providers.
+         */
+        virtual void prefetch() = 0;
+
+        /**
+         * Whether `feed` returns the content without waiting for it.
+         *
+         * Once `prefetch` returns, the content of a provider which is not
+         * ready is read in memory by the fetch thread, unless it is too big.
+         * A provider fetching its content asynchronously should return false
+         * until the content is fetched.
+         */
+        virtual bool ready() const = 0;
+    };
+
     /**
      * StringProvider provide the content stored in a string.
      */
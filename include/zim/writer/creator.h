@@ -22,6 +22,7 @@
 #define ZIM_WRITER_CREATOR_H
 
 #include <memory>
+#include <vector>
 #include <zim/zim.h>
 #include <zim/writer/item.h>
 
@@ -43,10 +44,58 @@ namespace zim
      *
      * During the creation of the zim file (and before the call to `finishZimCreation`),
      * some values must be set using the `set*` methods.
+     *
+     * `addItem`, `addMetadata` and `addRedirection` may be called
+     * concurrently from several threads. Each thread fills its own
+     * clusters, so adding entries from several threads scales with the
+     * number of threads. The other methods must not be called
+     * concurrently, and `finishZimCreation` must be called once all the
+     * `add*` calls have returned.
+     * If several threads add entries with the same path, the entry kept is
+     * not specified.
      */
     class Creator
     {
       public:
+        /**
+         * A snapshot of the progress of the creation (see `getProgress`).
+         *
+         * Counters are cumulative since the start of the creation.
+         * Times are the sum of the time spent by the threads of a stage,
+         * so they may be greater than the elapsed time.
+         */
+        struct Progress
+        {
+          double elapsedTime = 0;            // In seconds.
+
+          entry_index_type itemCount = 0;    // Items and metadata.
+          entry_index_type redirectCount = 0;
+          entry_index_type indexedItemCount = 0;
+
+          cluster_index_type closedClusterCount = 0;
+          cluster_index_type compressedClusterCount = 0;
+          cluster_index_type writtenClusterCount = 0;
+
+          size_type inputSize = 0;           // Content of the added items.
+          // Content compressed so far and its compressed size.
+          size_type compressedInputSize = 0;
+          size_type compressedOutputSize = 0;
+          size_type writtenSize = 0;         // Clusters written to the archive.
+
+          size_t taskQueueSize = 0;          // Compression and indexing tasks.
+          size_t clusterQueueSize = 0;       // Clusters waiting to be written.
+          size_type pendingClusterMemory = 0;
+
+          double compressionTime = 0;        // In seconds.
+          double indexingTime = 0;
+          double titleIndexingTime = 0;
+          double writingTime = 0;
+
+          // Throughput (in MB per second) since the previous call to
+          // `getProgress` (or since the start of the creation).
+          double inputMBps = 0;
+          double writtenMBps = 0;
+        };
 
         /**
          * Creator constructor.
@@ -73,6 +122,51 @@ namespace zim
          */
         Creator& configCompression(CompressionType comptype);
 
+        /**
+         * Configure the compression level.
+         *
+         * The level is specific to the compression algorithm
+         * (0-10 for lzma, 1-22 for zstd). Lower levels are faster but
+         * compress less. The lzma levels 0 to 9 are the presets of xz, the
+         * level 10 is the preset 9 with the extreme flag (`xz -9e`).
+         *
+         * @param level The compression level to use or a negative value
+         *              (the default) to use the best (and slowest) level.
+         * @return a reference to itself.
+         */
+        Creator& configCompressionLevel(int level);
+
+        /**
+         * Let the creator adapt the compression level to a throughput target.
+         *
+         * The creator measures the throughput of the compression workers and
+         * chooses the level of each cluster to keep up with the target.
+         * The configured compression level is the highest level used.
+         *
+         * @param targetMBps The compression throughput to reach (in MB of
+         *                   uncompressed data per second) or 0 (the default)
+         *                   to always use the configured level.
+         * @return a reference to itself.
+         */
+        Creator& configAdaptiveCompressionLevel(double targetMBps);
+
+        /**
+         * Decide the compression of the items from their content.
+         *
+         * By default, the content of an item is compressed depending on its
+         * mimetype only. If set, the beginning (up to 16KB) of the content of
+         * the items without a `COMPRESS` hint is sampled and the content is
+         * compressed only if its byte entropy is low enough. This way,
+         * already compressed content with a generic mimetype is stored as is
+         * and compressible content with an unknown mimetype is compressed.
+         * Items smaller than 1KB are still compressed depending on their
+         * mimetype.
+         *
+         * @param detect True to detect the compression from the content.
+         * @return a reference to itself.
+         */
+        Creator& configCompressionDetection(bool detect);
+
         /**
          * Set the minimum size of the cluster.
          *
@@ -84,6 +178,126 @@ namespace zim
          */
         Creator& configMinClusterSize(zim::size_type size);
 
+        /**
+         * Configure the seekable layout of the compressed clusters.
+         *
+         * If set (and the compression is zstd), compressed clusters are
+         * written as a sequence of independent frames of `frameSize`
+         * uncompressed bytes, preceded by an index of the frames.
+         * Readers then only have to decompress the frames covering the
+         * data they want to access, at the cost of a slightly lower
+         * compression ratio.
+         * Such clusters stay readable by older libzim versions.
+         *
+         * @param frameSize The uncompressed size of a frame (lower than 2GiB)
+         *                  or 0 (the default) to write classic clusters.
+         * @return a reference to itself.
+         */
+        Creator& configClusterFrameSize(zim::size_type frameSize);
+
+        /**
+         * Set the size from which an item is streamed in its own cluster.
+         *
+         * The cluster of such an item is not compressed in memory: a worker
+         * compresses it in a temporary file (next to the archive), which is
+         * then copied to the archive. This way, the memory used doesn't
+         * depend on the size of the item (as long as its content provider
+         * doesn't keep it in memory), but the compressed item is written
+         * twice to the disk.
+         *
+         * @param size The size (in bytes) of the smallest streamed item
+         *             or 0 (the default) to never stream the items.
+         * @return a reference to itself.
+         */
+        Creator& configStreamedItemSize(zim::size_type size);
+
+        /**
+         * Store the directory entries out of the memory.
+         *
+         * By default, all the directory entries are kept in memory until the
+         * end of the creation, which needs a lot of memory for archives with
+         * a huge number of entries.
+         * If set, the entries are stored in temporary files (next to the
+         * archive) and sorted with an external merge sort. The memory used
+         * for them then depends on `memoryBudget`, not on the number of
+         * entries. The sorted runs are prepared by up to `configNbWorkers`
+         * threads.
+         *
+         * @param memoryBudget The memory (in bytes) to use to sort the
+         *                     entries or 0 (the default) to keep all the
+         *                     entries in memory.
+         * @return a reference to itself.
+         */
+        Creator& configExternalDirentSort(zim::size_type memoryBudget);
+
+        /**
+         * Group similar items in the compressed clusters.
+         *
+         * By default, compressed items are put in clusters in the order
+         * they are added. If set, the creator buffers the compressed items
+         * by windows of `windowSize` items and packs each window grouping
+         * the items by mimetype and path (items of the same "directory" are
+         * put together). This usually improves the compression ratio and
+         * the chance that entries read together are in the same cluster.
+         * The content of the buffered items (if held by their content
+         * provider) is kept in memory until the window is packed.
+         *
+         * @param windowSize The number of items to group or 0 (the default)
+         *                   to keep the items in their order.
+         * @return a reference to itself.
+         */
+        Creator& configClusteringWindow(zim::size_type windowSize);
+
+        /**
+         * Store the content shared by several items only once.
+         *
+         * If set, the content of the items is hashed (SHA-256) and items
+         * with the same content as a previous item point to the data of this
+         * previous item instead of storing it again.
+         * The content of the items provided by a custom `ContentProvider` is
+         * read in memory to be hashed, so such items bigger than 16MB are not
+         * deduplicated.
+         *
+         * @param dedup True to deduplicate the content of the items.
+         * @return a reference to itself.
+         */
+        Creator& configDeduplication(bool dedup);
+
+        /**
+         * Limit the memory used by the clusters waiting to be written.
+         *
+         * Closed clusters keep their content (and, once compressed, their
+         * compressed data) in memory until they are written. If set,
+         * `addItem` (and the other `add*` methods) block while the data
+         * of the clusters waiting to be compressed or written exceeds
+         * `budget`. A single cluster bigger than the budget is still
+         * accepted when no other cluster is waiting.
+         *
+         * @param budget The memory (in bytes) or 0 (the default) to only
+         *               limit the number of waiting clusters.
+         * @return a reference to itself.
+         */
+        Creator& configClusterMemoryBudget(zim::size_type budget);
+
+        /**
+         * Configure the order in which the clusters are written.
+         *
+         * By default (a window of 0), clusters are written in the order
+         * they are closed: the layout of the zim file doesn't depend on
+         * the scheduling of the workers, so the same input gives the same
+         * file.
+         * With a window, a compressed cluster is written as soon as at
+         * most `window` clusters closed before it are still waiting, so a
+         * cluster slow to compress doesn't delay the writing of the other
+         * ones. The layout of the zim file then depends on the scheduling
+         * of the workers.
+         *
+         * @param window The number of clusters a cluster may overtake
+         *               (`std::numeric_limits<size_t>::max()` for no limit).
+         * @return a reference to itself.
+         */
+        Creator& configClusterReorderWindow(size_t window);
+
         /**
          * Configure the fulltext indexing feature.
          *
@@ -101,6 +315,16 @@ namespace zim
          */
         Creator& configNbWorkers(unsigned nbWorkers);
 
+        /**
+         * Set the number of threads fetching the content in `addItems`.
+         *
+         * @param nbFetchers The number of items fetched at the same time
+         *                   (4 by default) or 0 to fetch the content of the
+         *                   items when it is compressed, as `addItem` does.
+         * @return a reference to itself.
+         */
+        Creator& configFetchConcurrency(unsigned nbFetchers);
+
         /**
          * Start the zim creation.
          *
@@ -110,6 +334,44 @@ namespace zim
          */
         void startZimCreation(const std::string& filepath);
 
+        /**
+         * Start the creation of a zim file updating an existing one.
+         *
+         * The new zim file contains the entries of the existing one plus
+         * the added entries. An added entry replaces the existing entry
+         * with the same path.
+         * The content of the existing entries is not recompressed: the
+         * clusters containing it are copied as they are, so the time
+         * needed mostly depends on the added content.
+         * The title and fulltext indexes are recreated (the html content
+         * of the existing entries is read back to be fulltext indexed).
+         * The existing entries are indexed by the worker threads in the
+         * order of their content in the archive, so each cluster is
+         * decompressed once.
+         *
+         * The title index is recreated by a libzim built with xapian, the
+         * fulltext index only if `configIndexing` is also set. An index
+         * which is not recreated is copied from the existing archive as it
+         * is: it doesn't know the added entries and may still return the
+         * removed ones. The other entries of the 'X' namespace are kept.
+         *
+         * To add a fulltext index to an archive created without one, update
+         * it with `configIndexing(true, language)` and without adding any
+         * entry: the clusters are copied and only the dirents, the indexes
+         * and the pointer tables are written again.
+         *
+         * Updating an archive is not compatible with
+         * `configExternalDirentSort`, nor with split archives, nor with
+         * archives using the old namespace scheme (zim version 5, with
+         * the 'A', 'I'... namespaces).
+         *
+         * @param filepath the path of the zim file to create. It may be the
+         *                 path of the existing zim file, which is replaced at
+         *                 the end of the creation.
+         * @param existingPath the path of the zim file to update.
+         */
+        void startZimUpdate(const std::string& filepath, const std::string& existingPath);
+
         /**
          * Add a item to the archive.
          *
@@ -117,6 +379,26 @@ namespace zim
          */
         void addItem(std::shared_ptr<Item> item);
 
+        /**
+         * Add several items to the archive.
+         *
+         * This is the same as calling `addItem` for each item, in order,
+         * but the content of the next items is fetched by
+         * `configFetchConcurrency` threads while the previous items are
+         * added and compressed: `getContentProvider` and
+         * `PrefetchableProvider::prefetch` (for the providers implementing
+         * it) are called from these threads, for several items at the same
+         * time. The content of the providers not `ready` after `prefetch`,
+         * and of the custom providers not implementing
+         * `PrefetchableProvider`, is read in memory (up to 16MB).
+         *
+         * This way, the slow content providers (network, slow disk...) are
+         * not consumed one after the other.
+         *
+         * @param items The items to add.
+         */
+        void addItems(const std::vector<std::shared_ptr<Item>>& items);
+
         /**
          * Add a metadata to the archive.
          *
@@ -149,11 +431,33 @@ namespace zim
             const std::string& title,
             const std::string& targetpath);
 
+        /**
+         * Remove an entry of the archive updated (see `startZimUpdate`).
+         *
+         * The existing entry at `path` (and the existing redirections to
+         * it) are not kept in the new archive. An entry added with the same
+         * path is kept.
+         *
+         * @param path the path of the entry to remove.
+         */
+        void removeEntry(const std::string& path);
+
         /**
          * Finalize the zim creation.
          */
         void finishZimCreation();
 
+        /**
+         * Get the progress of the creation.
+         *
+         * This may be called from any thread, at any time during the
+         * creation. The counters are read without blocking the creation.
+         * Called before `startZimCreation`, it returns an empty progress.
+         *
+         * @return a snapshot of the progress.
+         */
+        Progress getProgress() const;
+
         /**
          * Set the path of the main page.
          *
@@ -183,8 +487,19 @@ namespace zim
         CompressionType m_compression = zimcompLzma;
         bool m_withIndex = false;
         size_t m_minClusterSize = 1024-64;
+        zim::size_type m_clusterFrameSize = 0;
+        zim::size_type m_streamedItemSize = 0;
+        int m_compressionLevel = -1;
+        double m_adaptiveCompressionTarget = 0;
+        bool m_compressionDetection = false;
+        zim::size_type m_externalSortMemory = 0;
+        zim::size_type m_clusteringWindow = 0;
+        bool m_deduplication = false;
+        zim::size_type m_clusterMemoryBudget = 0;
+        size_t m_clusterReorderWindow = 0;
         std::string m_indexingLanguage;
         unsigned m_nbWorkers = 4;
+        unsigned m_nbFetchers = 4;
 
         // zim data
         std::string m_mainPath;
@@ -25,6 +25,11 @@
 #include "fileimpl.h"
 #include "tools.h"
 #include "log.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <sstream>
 
 log_define("zim.archive")
 
@@ -310,6 +315,11 @@ namespace zim
     return m_impl->verify();
   }
 
+  bool Archive::check(const std::function<void(size_type, size_type)>& progress) const
+  {
+    return m_impl->verify(progress);
+  }
+
   bool Archive::is_multiPart() const
   {
     return m_impl->is_multiPart();
@@ -366,10 +376,67 @@ namespace zim
     try
     {
       Archive a(zimPath);
-      for ( size_t i = 0; i < checksToRun.size(); ++i )
+      const auto impl = a.getImpl();
+
+      // The checks are run concurrently by a pool of threads, each one
+      // writing its problems in its own stream. Only the problems of the
+      // first failing check are reported, as if the checks were run one
+      // after the other: once a check failed, the next checks stop.
+      const size_t count = checksToRun.size();
+      std::vector<std::ostringstream> problems(count);
+      std::vector<std::shared_future<bool>> results(count);
+      std::atomic<size_t> firstFailedCheck(count);
+      // Declared last: its destructor waits for the running checks, which
+      // use the variables above.
+      ThreadPool pool(std::max(1U, std::thread::hardware_concurrency()));
+      const auto runCheck = [&](IntegrityCheck checkType) {
+        const size_t i = size_t(checkType);
+        if ( !checksToRun.test(i) )
+          return;
+        auto& problem = problems[i];
+        results[i] = pool.submit([=, &problem, &pool, &firstFailedCheck]() {
+          const auto cancelled = [=, &firstFailedCheck]() { return firstFailedCheck.load() < i; };
+          if ( !impl->checkIntegrity(checkType, problem, pool, cancelled) ) {
+            auto current = firstFailedCheck.load();
+            while ( current > i && !firstFailedCheck.compare_exchange_weak(current, i) ) {}
+            return false;
+          }
+          return true;
+        }).share();
+      };
+
+      runCheck(IntegrityCheck::CHECKSUM);
+      runCheck(IntegrityCheck::DIRENT_PTRS);
+      runCheck(IntegrityCheck::CLUSTER_PTRS);
+
+      // Checks reading the dirents need valid dirent pointers, they are run
+      // once the DIRENT_PTRS check (if it is run) succeeded.
+      auto& direntPtrsResult = results[size_t(IntegrityCheck::DIRENT_PTRS)];
+      bool validDirentPtrs = true;
+      if ( direntPtrsResult.valid() ) {
+        pool.wait(direntPtrsResult);
+        try {
+          validDirentPtrs = direntPtrsResult.get();
+        } catch (...) {
+          validDirentPtrs = false; // Rethrown below
+        }
+      }
+      if ( validDirentPtrs ) {
+        runCheck(IntegrityCheck::DIRENT_ORDER);
+        runCheck(IntegrityCheck::TITLE_INDEX);
+      }
+
+      for ( size_t i = 0; i < count; ++i )
       {
-        if ( checksToRun.test(i) && !a.checkIntegrity(IntegrityCheck(i)) )
+        if ( !results[i].valid() )
+          continue;
+        pool.wait(results[i]);
+        if ( i == firstFailedCheck ) {
+          std::cerr << problems[i].str();
           return false;
+        }
+        // Rethrow the error of the check, if any.
+        results[i].get();
       }
     }
     catch(ZimFileFormatError &exception)
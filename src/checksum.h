@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_CHECKSUM_H
+#define ZIM_CHECKSUM_H
+
+#include <zim/zim.h>
+
+#include "md5.h"
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <vector>
+
+namespace zim
+{
+  // Called with the number of bytes already processed and the total
+  // number of bytes to process.
+  typedef std::function<void(size_type, size_type)> ProgressCallback;
+
+  // Size of the blocks read to compute a checksum.
+  const size_t CHECKSUM_BLOCK_SIZE = 4*1024*1024;
+
+  // Compute the md5 of the `size` first bytes of a file.
+  // `read(char* dest, offset_type offset, size_t size)` must read `size`
+  // bytes at `offset` (or throw).
+  // The file is read by big blocks, the next block being read in a
+  // background thread while the current one is hashed.
+  template<typename Read>
+  void computeMd5(Read read, size_type size, unsigned char digest[16],
+                  const ProgressCallback& progress = nullptr)
+  {
+    struct zim_MD5_CTX md5ctx;
+    zim_MD5Init(&md5ctx);
+
+    auto readBlock = [&read, size](offset_type offset, std::vector<char>* buffer) {
+      buffer->resize(std::min<size_type>(CHECKSUM_BLOCK_SIZE, size - offset));
+      read(buffer->data(), offset, buffer->size());
+    };
+
+    std::vector<char> current;
+    std::vector<char> next;
+    offset_type offset = 0;
+    if (size) {
+      readBlock(0, &current);
+    }
+    while (offset < size) {
+      const offset_type nextOffset = offset + current.size();
+      std::future<void> pendingRead;
+      if (nextOffset < size) {
+        pendingRead = std::async(std::launch::async, readBlock, nextOffset, &next);
+      }
+      zim_MD5Update(&md5ctx, reinterpret_cast<const unsigned char*>(current.data()), current.size());
+      if (pendingRead.valid()) {
+        pendingRead.get();
+      }
+      offset = nextOffset;
+      if (progress) {
+        progress(offset, size);
+      }
+      current.swap(next);
+    }
+    zim_MD5Final(digest, &md5ctx);
+  }
+}
+
+#endif // ZIM_CHECKSUM_H
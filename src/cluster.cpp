@@ -25,6 +25,7 @@
 #include "bufferstreamer.h"
 #include "decoderstreamreader.h"
 #include "rawstreamreader.h"
+#include "frames_reader.h"
 #include <algorithm>
 #include <stdlib.h>
 #include <sstream>
@@ -44,14 +45,61 @@ namespace zim
 namespace
 {
 
+// Read the frame index of a seekable cluster and return a reader on the
+// uncompressed content of the cluster.
+// The frame index is stored in a zstd skippable frame just before the frames
+// themselves :
+//  - magic number (4 bytes)
+//  - size of the index (4 bytes)
+//  - uncompressed size of the frames (4 bytes)
+//  - number of frames (4 bytes)
+//  - uncompressed size of the whole cluster (8 bytes)
+//  - compressed size of each frame (4 bytes each)
+std::shared_ptr<const Reader>
+getFramesReader(const Reader& reader)
+{
+  if (reader.read_uint<uint32_t>(offset_t(0)) != ZSTD_FRAME_INDEX_MAGIC) {
+    throw ZimFileFormatError("Invalid frame index for cluster.");
+  }
+  const zsize_t indexSize(reader.read_uint<uint32_t>(offset_t(4)));
+  const auto buffer = reader.get_buffer(offset_t(8), indexSize);
+  auto seqReader = BufferStreamer(buffer, indexSize);
+
+  FrameIndex index;
+  index.frameSize = zsize_t(seqReader.read<uint32_t>());
+  const auto frameCount = seqReader.read<uint32_t>();
+  index.dataSize = zsize_t(seqReader.read<uint64_t>());
+  if ( index.frameSize.v == 0
+    || indexSize.v != 16 + 4 * size_type(frameCount)
+    || frameCount != (index.dataSize.v + index.frameSize.v - 1) / index.frameSize.v ) {
+    throw ZimFileFormatError("Invalid frame index for cluster.");
+  }
+
+  index.offsets.reserve(frameCount+1);
+  offset_t frameOffset(0);
+  index.offsets.push_back(frameOffset);
+  for (uint32_t i = 0; i < frameCount; ++i) {
+    frameOffset += zsize_t(seqReader.read<uint32_t>());
+    index.offsets.push_back(frameOffset);
+  }
+
+  auto framesSource = std::shared_ptr<const Reader>(reader.sub_reader(offset_t(8) + indexSize));
+  return std::make_shared<FramesReader<ZSTD_INFO>>(framesSource, std::move(index));
+}
+
 std::unique_ptr<IStreamReader>
 getClusterReader(const Reader& zimReader, offset_t offset, CompressionType* comp, bool* extended)
 {
   uint8_t clusterInfo = zimReader.read(offset);
   *comp = static_cast<CompressionType>(clusterInfo & 0x0F);
   *extended = clusterInfo & 0x10;
+  const bool seekable = clusterInfo & 0x20;
   auto subReader = std::shared_ptr<const Reader>(zimReader.sub_reader(offset+offset_t(1)));
 
+  if (seekable && *comp == zimcompZstd) {
+    return std::unique_ptr<IStreamReader>(new RawStreamReader(getFramesReader(*subReader)));
+  }
+
   switch (*comp) {
     case zimcompDefault:
     case zimcompNone:
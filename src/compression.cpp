@@ -2,6 +2,7 @@
 
 #include "envvalue.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 const std::string LZMA_INFO::name = "lzma";
@@ -15,10 +16,59 @@ void LZMA_INFO::init_stream_decoder(stream_t* stream, char* raw_data)
   }
 }
 
-void LZMA_INFO::init_stream_encoder(stream_t* stream, char* raw_data)
+namespace
+{
+// Levels 0 to 9 are the presets of liblzma, the best level (10) is the
+// extreme variant of the preset 9.
+uint32_t lzmaPreset(int level)
+{
+  return (level < 0 || level >= LZMA_INFO::max_level())
+         ? 9 | LZMA_PRESET_EXTREME
+         : level;
+}
+}
+
+size_t LZMA_INFO::mt_block_size(int level)
+{
+  lzma_options_lzma options;
+  if (lzma_lzma_preset(&options, lzmaPreset(level))) {
+    return MT_COMPRESSION_BLOCK_SIZE;
+  }
+  return std::max<size_t>(options.dict_size, MT_COMPRESSION_BLOCK_SIZE);
+}
+
+unsigned LZMA_INFO::mt_encoder_threads(int level, unsigned nbThreads)
+{
+  lzma_mt options = {};
+  options.threads = nbThreads;
+  options.block_size = mt_block_size(level);
+  options.preset = lzmaPreset(level);
+  options.check = LZMA_CHECK_CRC32;
+  const uint64_t maxMemoryPerThread = zim::envMemSize("ZIM_LZMA_MT_ENCODER_MEMORY_SIZE",
+                                                      LZMA_MT_ENCODER_MEMORY_SIZE * 1024 * 1024);
+  while (options.threads > 1
+      && lzma_stream_encoder_mt_memusage(&options) > maxMemoryPerThread * options.threads) {
+    options.threads--;
+  }
+  return options.threads;
+}
+
+void LZMA_INFO::init_stream_encoder(stream_t* stream, char* raw_data, int level, unsigned nbThreads)
 {
   *stream = LZMA_STREAM_INIT;
-  auto errcode = lzma_easy_encoder(stream, 9 | LZMA_PRESET_EXTREME, LZMA_CHECK_CRC32);
+  const uint32_t preset = lzmaPreset(level);
+  // The multithreaded encoder splits the data in blocks of a xz stream.
+  lzma_mt options = {};
+  options.threads = nbThreads > 1 ? mt_encoder_threads(level, nbThreads) : 1;
+  options.block_size = mt_block_size(level);
+  options.preset = preset;
+  options.check = LZMA_CHECK_CRC32;
+  lzma_ret errcode;
+  if (options.threads > 1) {
+    errcode = lzma_stream_encoder_mt(stream, &options);
+  } else {
+    errcode = lzma_easy_encoder(stream, preset, LZMA_CHECK_CRC32);
+  }
   if (errcode != LZMA_OK) {
     throw std::runtime_error("Cannot initialize lzma_easy_encoder");
   }
@@ -85,13 +135,26 @@ void ZSTD_INFO::init_stream_decoder(stream_t* stream, char* raw_data)
   }
 }
 
-void ZSTD_INFO::init_stream_encoder(stream_t* stream, char* raw_data)
+void ZSTD_INFO::init_stream_encoder(stream_t* stream, char* raw_data, int level, unsigned nbThreads)
 {
+  if (level < 0 || level > max_level()) {
+    level = max_level();
+  } else if (level < min_level()) {
+    level = min_level();
+  }
   stream->encoder_stream = ::ZSTD_createCStream();
-  auto ret = ::ZSTD_initCStream(stream->encoder_stream, ::ZSTD_maxCLevel());
+  auto ret = ::ZSTD_initCStream(stream->encoder_stream, level);
   if (::ZSTD_isError(ret)) {
     throw std::runtime_error("Failed to initialize Zstd compression");
   }
+  if (nbThreads > 1) {
+    // This fails if libzstd is built without multithreading support.
+    // We simply compress in the current thread then.
+    ret = ::ZSTD_CCtx_setParameter(stream->encoder_stream, ::ZSTD_c_nbWorkers, nbThreads);
+    if (!::ZSTD_isError(ret)) {
+      ::ZSTD_CCtx_setParameter(stream->encoder_stream, ::ZSTD_c_jobSize, MT_COMPRESSION_BLOCK_SIZE);
+    }
+  }
 }
 
 CompStatus ZSTD_INFO::stream_run_encode(stream_t* stream, CompStep step) {
@@ -105,9 +168,16 @@ CompStatus ZSTD_INFO::stream_run_encode(stream_t* stream, CompStep step) {
   outBuf.size = stream->avail_out;
   outBuf.pos = 0;
 
-  auto ret = step == CompStep::STEP
-           ? ::ZSTD_compressStream(stream->encoder_stream, &outBuf, &inBuf)
-           : ::ZSTD_endStream(stream->encoder_stream, &outBuf);
+  size_t ret;
+  if (step == CompStep::STEP) {
+    // In multithreaded mode, zstd may return before consuming all the
+    // input even if there is still room in the output buffer.
+    do {
+      ret = ::ZSTD_compressStream(stream->encoder_stream, &outBuf, &inBuf);
+    } while (!::ZSTD_isError(ret) && inBuf.pos < inBuf.size && outBuf.pos < outBuf.size);
+  } else {
+    ret = ::ZSTD_endStream(stream->encoder_stream, &outBuf);
+  }
   stream->next_in += inBuf.pos;
   stream->avail_in -= inBuf.pos;
   stream->next_out += outBuf.pos;
@@ -1,6 +1,7 @@
 #ifndef _LIBZIM_COMPRESSION_
 #define _LIBZIM_COMPRESSION_
 
+#include <functional>
 #include <vector>
 #include "string.h"
 
@@ -29,6 +30,17 @@ enum class CompStatus {
   OTHER
 };
 
+// Minimal size of the chunks independently compressed by each thread of a
+// multithreaded compression (see `INFO::mt_block_size`).
+const size_t MT_COMPRESSION_BLOCK_SIZE = 16*1024*1024;
+
+// Maximal memory (in MB) used by each thread of a multithreaded lzma
+// encoder. Each thread has its own encoder (and buffers), a thread
+// compressing with the best level needs about 900MB. Less threads than
+// asked are used if needed (down to a single threaded encoder).
+// May be changed with the ZIM_LZMA_MT_ENCODER_MEMORY_SIZE env variable.
+const unsigned LZMA_MT_ENCODER_MEMORY_SIZE = 1024;
+
 enum class RunnerStatus {
   OK,
   NEED_MORE,
@@ -38,8 +50,17 @@ enum class RunnerStatus {
 struct LZMA_INFO {
   typedef lzma_stream stream_t;
   static const std::string name;
+  static int min_level() { return 0; }
+  // Level 10 is the extreme variant of the level 9.
+  static int max_level() { return 10; }
+  // A block is at least as big as the dictionary of the level, smaller
+  // blocks would not use the whole dictionary.
+  static size_t mt_block_size(int level);
+  // Number of threads (up to nbThreads) of a multithreaded encoder fitting
+  // in the memory limit.
+  static unsigned mt_encoder_threads(int level, unsigned nbThreads);
   static void init_stream_decoder(stream_t* stream, char* raw_data);
-  static void init_stream_encoder(stream_t* stream, char* raw_data);
+  static void init_stream_encoder(stream_t* stream, char* raw_data, int level, unsigned nbThreads);
   static CompStatus stream_run_encode(stream_t* stream, CompStep step);
   static CompStatus stream_run_decode(stream_t* stream, CompStep step);
   static CompStatus stream_run(stream_t* stream, CompStep step);
@@ -68,14 +89,21 @@ struct ZSTD_INFO {
   };
 
   static const std::string name;
+  static int min_level() { return 1; }
+  static int max_level() { return ::ZSTD_maxCLevel(); }
+  static size_t mt_block_size(int /*level*/) { return MT_COMPRESSION_BLOCK_SIZE; }
   static void init_stream_decoder(stream_t* stream, char* raw_data);
-  static void init_stream_encoder(stream_t* stream, char* raw_data);
+  static void init_stream_encoder(stream_t* stream, char* raw_data, int level, unsigned nbThreads);
   static CompStatus stream_run_encode(stream_t* stream, CompStep step);
   static CompStatus stream_run_decode(stream_t* stream, CompStep step);
   static void stream_end_encode(stream_t* stream);
   static void stream_end_decode(stream_t* stream);
 };
 
+// Magic number of the zstd skippable frame storing the frame index of a
+// seekable cluster. Plain zstd decoders simply skip it.
+const uint32_t ZSTD_FRAME_INDEX_MAGIC = 0x184D2A5E;
+
 
 namespace zim {
 
@@ -206,8 +234,12 @@ class Compressor
 
     ~Compressor() = default;
 
-    void init(char* data) {
-      INFO::init_stream_encoder(&stream, data);
+    // A negative level means the best (and slowest) level of the algorithm.
+    // With several threads, the data is compressed by blocks of
+    // MT_COMPRESSION_BLOCK_SIZE in parallel. The result is still a
+    // single stream which can be decompressed as usual.
+    void init(char* data, int level=-1, unsigned nbThreads=1) {
+      INFO::init_stream_encoder(&stream, data, level, nbThreads);
       stream.next_out = (uint8_t*)ret_data.get();
       stream.avail_out = ret_size;
     }
@@ -219,12 +251,10 @@ class Compressor
       while (true) {
         errcode = INFO::stream_run_encode(&stream, step);
         if (stream.avail_out == 0) {
-          if (errcode == CompStatus::OK) {
-            // lzma return a OK return status the first time it runs out of output memory.
-            // The BUF_ERROR is returned only the second time we call a lzma_code.
-            continue;
-          }
-          if (errcode == CompStatus::BUF_ERROR) {
+          // lzma return a OK return status the first time it runs out of output memory.
+          // zstd return OK if it consumed all the input while filling the output,
+          // and keeps returning OK as long as there is no room to flush.
+          if (errcode == CompStatus::OK || errcode == CompStatus::BUF_ERROR) {
             //Not enought output size
             ret_size *= 2;
             std::unique_ptr<char[]> new_ret_data(new char[ret_size]);
@@ -257,6 +287,74 @@ class Compressor
     typename INFO::stream_t stream;
 };
 
+// Same as Compressor, but the compressed data is given to `output` by
+// chunks of (at most) `buffer_size` bytes as soon as it is produced instead
+// of being kept in memory. The memory used doesn't depend on the size of
+// the data.
+template<typename INFO>
+class StreamCompressor
+{
+  public:
+    typedef std::function<void(const char* data, size_t size)> output_t;
+
+    StreamCompressor(output_t output, size_t buffer_size=1024*1024) :
+      output(output),
+      buffer(new char[buffer_size]),
+      buffer_size(buffer_size),
+      total_size(0)
+    {}
+
+    void init(char* data, int level=-1, unsigned nbThreads=1) {
+      INFO::init_stream_encoder(&stream, data, level, nbThreads);
+      stream.next_out = (uint8_t*)buffer.get();
+      stream.avail_out = buffer_size;
+    }
+
+    void feed(const char* data, size_t size, CompStep step=CompStep::STEP) {
+      stream.next_in = (unsigned char*)data;
+      stream.avail_in = size;
+      while (true) {
+        auto errcode = INFO::stream_run_encode(&stream, step);
+        if (stream.avail_out == 0) {
+          flush();
+          if (errcode == CompStatus::OK || errcode == CompStatus::BUF_ERROR) {
+            // The compressor may have more to output.
+            continue;
+          }
+        }
+        if (errcode == CompStatus::STREAM_END || errcode == CompStatus::OK) {
+          break;
+        }
+        throw std::runtime_error("Error while compressing with " + INFO::name);
+      }
+    }
+
+    // Return the size of the compressed data.
+    zim::zsize_t finish() {
+      feed(nullptr, 0, CompStep::FINISH);
+      flush();
+      INFO::stream_end_encode(&stream);
+      return zim::zsize_t(total_size);
+    }
+
+  private:
+    void flush() {
+      const size_t size = buffer_size - stream.avail_out;
+      if (size) {
+        output(buffer.get(), size);
+        total_size += size;
+      }
+      stream.next_out = (uint8_t*)buffer.get();
+      stream.avail_out = buffer_size;
+    }
+
+    output_t output;
+    std::unique_ptr<char[]> buffer;
+    size_t buffer_size;
+    zim::size_type total_size;
+    typename INFO::stream_t stream;
+};
+
 } // namespace zim
 
 #endif // _LIBZIM_COMPRESSION_
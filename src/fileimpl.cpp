@@ -22,17 +22,22 @@
 #include "_dirent.h"
 #include "file_compound.h"
 #include "buffer_reader.h"
+#include "endian_tools.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sstream>
 #include <errno.h>
 #include <cstring>
-#include <fstream>
+#include <iostream>
+#include <atomic>
+#include <future>
+#include <thread>
 #include "config.h"
 #include "log.h"
 #include "envvalue.h"
-#include "md5.h"
+#include "checksum.h"
 #include "tools.h"
+#include "thread_pool.h"
 
 log_define("zim.file.impl")
 
@@ -312,6 +317,12 @@ sectionSubReader(const FileReader& zimReader, const std::string& sectionName,
   }
 
   std::shared_ptr<const Dirent> FileImpl::readDirent(offset_t indexOffset)
+  {
+    std::lock_guard<std::mutex> l(bufferDirentLock);
+    return readDirent(indexOffset, bufferDirentZone);
+  }
+
+  std::shared_ptr<const Dirent> FileImpl::readDirent(offset_t indexOffset, std::vector<char>& buffer) const
   {
     // We don't know the size of the dirent because it depends of the size of
     // the title, url and extra parameters.
@@ -321,28 +332,25 @@ sectionSubReader(const FileReader& zimReader, const std::string& sectionName,
     // Most dirent will be "Article" entry (header's size == 16) without extra parameters.
     // Let's hope that url + title size will be < 256 and if not try again with a bigger size.
     std::shared_ptr<const Dirent> dirent;
-    {
-      std::lock_guard<std::mutex> l(bufferDirentLock);
-      zsize_t bufferSize = zsize_t(256);
-      // On very small file, the offset + 256 is higher than the size of the file,
-      // even if the file is valid.
-      // So read only to the end of the file.
-      auto totalSize = zimReader->size();
-      if (indexOffset.v + 256 > totalSize.v) bufferSize = zsize_t(totalSize.v-indexOffset.v);
-      while (true) {
-          bufferDirentZone.reserve(size_type(bufferSize));
-          zimReader->read(bufferDirentZone.data(), indexOffset, bufferSize);
-          auto direntBuffer = Buffer::makeBuffer(bufferDirentZone.data(), bufferSize);
-          try {
-            dirent = std::make_shared<const Dirent>(direntBuffer);
-          } catch (InvalidSize&) {
-            // buffer size is not enougth, try again :
-            bufferSize += 256;
-            continue;
-          }
-          // Success !
-          break;
-      }
+    zsize_t bufferSize = zsize_t(256);
+    // On very small file, the offset + 256 is higher than the size of the file,
+    // even if the file is valid.
+    // So read only to the end of the file.
+    auto totalSize = zimReader->size();
+    if (indexOffset.v + 256 > totalSize.v) bufferSize = zsize_t(totalSize.v-indexOffset.v);
+    while (true) {
+        buffer.resize(size_type(bufferSize));
+        zimReader->read(buffer.data(), indexOffset, bufferSize);
+        auto direntBuffer = Buffer::makeBuffer(buffer.data(), bufferSize);
+        try {
+          dirent = std::make_shared<const Dirent>(direntBuffer);
+        } catch (InvalidSize&) {
+          // buffer size is not enougth, try again :
+          bufferSize += 256;
+          continue;
+        }
+        // Success !
+        break;
     }
 
     log_debug("dirent read from " << indexOffset);
@@ -414,6 +422,11 @@ sectionSubReader(const FileReader& zimReader, const std::string& sectionName,
     return readOffset(*clusterOffsetReader, idx.v);
   }
 
+  offset_t FileImpl::getDirentOffset(entry_index_t idx) const
+  {
+    return readOffset(*urlPtrOffsetReader, idx.v);
+  }
+
   offset_t FileImpl::getBlobOffset(cluster_index_t clusterIdx, blob_index_t blobIdx)
   {
     auto cluster = getCluster(clusterIdx);
@@ -490,48 +503,36 @@ sectionSubReader(const FileReader& zimReader, const std::string& sectionName,
     }
   }
 
-  bool FileImpl::verify()
+  bool FileImpl::verify(const ProgressCallback& progress)
   {
     if (!header.hasChecksum())
       return false;
 
-    struct zim_MD5_CTX md5ctx;
-    zim_MD5Init(&md5ctx);
+    const offset_type checksumPos = header.getChecksumPos();
+    if (checksumPos + 16 > zimReader->size().v) {
+      return false;
+    }
 
-    offset_type checksumPos = header.getChecksumPos();
-    offset_type currentPos = 0;
     for(auto part = zimFile->begin();
         part != zimFile->end();
         part++) {
-      std::ifstream stream(part->second->filename(), std::ios_base::in|std::ios_base::binary);
-
-      char ch;
-      for(/*NOTHING*/ ; currentPos < checksumPos && stream.get(ch).good(); currentPos++) {
-        zim_MD5Update(&md5ctx, reinterpret_cast<const uint8_t*>(&ch), 1);
-      }
-      if (stream.bad()) {
-        perror("error while reading file");
-        return false;
-      }
-      if (currentPos == checksumPos) {
-        break;
-      }
-    }
-
-    if (currentPos != checksumPos) {
-      return false;
+      part->second->fhandle().adviseSequential();
     }
 
     unsigned char chksumCalc[16];
-    auto chksumFile = zimReader->get_buffer(offset_t(header.getChecksumPos()), zsize_t(16));
-
-    zim_MD5Final(chksumCalc, &md5ctx);
-    if (std::memcmp(chksumFile.data(), chksumCalc, 16) != 0)
-    {
+    try {
+      computeMd5(
+        [this](char* dest, offset_type offset, size_t size) {
+          zimReader->read(dest, offset_t(offset), zsize_t(size));
+        },
+        checksumPos, chksumCalc, progress);
+    } catch (std::exception& e) {
+      std::cerr << "error while reading file: " << e.what() << std::endl;
       return false;
     }
 
-    return true;
+    auto chksumFile = zimReader->get_buffer(offset_t(checksumPos), zsize_t(16));
+    return std::memcmp(chksumFile.data(), chksumCalc, 16) == 0;
   }
 
   time_t FileImpl::getMTime() const {
@@ -547,114 +548,245 @@ sectionSubReader(const FileReader& zimReader, const std::string& sectionName,
   }
 
   bool FileImpl::checkIntegrity(IntegrityCheck checkType) {
+    ThreadPool pool(std::max(1U, std::thread::hardware_concurrency()));
+    return checkIntegrity(checkType, std::cerr, pool, []() { return false; });
+  }
+
+  bool FileImpl::checkIntegrity(IntegrityCheck checkType, std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled) {
     switch(checkType) {
-      case IntegrityCheck::CHECKSUM: return FileImpl::checkChecksum();
-      case IntegrityCheck::DIRENT_PTRS: return FileImpl::checkDirentPtrs();
-      case IntegrityCheck::DIRENT_ORDER: return FileImpl::checkDirentOrder();
-      case IntegrityCheck::TITLE_INDEX: return FileImpl::checkTitleIndex();
-      case IntegrityCheck::CLUSTER_PTRS: return FileImpl::checkClusterPtrs();
+      case IntegrityCheck::CHECKSUM: return FileImpl::checkChecksum(err, pool, cancelled);
+      case IntegrityCheck::DIRENT_PTRS: return FileImpl::checkDirentPtrs(err, pool, cancelled);
+      case IntegrityCheck::DIRENT_ORDER: return FileImpl::checkDirentOrder(err, pool, cancelled);
+      case IntegrityCheck::TITLE_INDEX: return FileImpl::checkTitleIndex(err, pool, cancelled);
+      case IntegrityCheck::CLUSTER_PTRS: return FileImpl::checkClusterPtrs(err, pool, cancelled);
       case IntegrityCheck::COUNT: ASSERT("shouldn't have reached here", ==, "");
     }
     return false;
   }
 
-  bool FileImpl::checkChecksum() {
-    if ( ! verify() ) {
-        std::cerr << "Checksum doesn't match" << std::endl;
-        return false;
+namespace
+{
+
+// Sequential reader of a table of little endian integers (pointer lists,
+// title index), reading the table by blocks instead of one integer at a time.
+template<typename T>
+class IntegerTableReader
+{
+  public:
+    explicit IntegerTableReader(const Reader& reader)
+      : m_reader(reader),
+        m_count(reader.size().v / sizeof(T)),
+        m_blockStart(0),
+        m_blockSize(0)
+    {}
+
+    T get(size_t idx)
+    {
+      if (idx < m_blockStart || idx >= m_blockStart + m_blockSize) {
+        m_blockStart = idx;
+        m_blockSize = std::min(BLOCK_SIZE, m_count - idx);
+        m_buffer.resize(m_blockSize * sizeof(T));
+        m_reader.read(m_buffer.data(), offset_t(idx * sizeof(T)), zsize_t(m_buffer.size()));
+      }
+      return fromLittleEndian<T>(m_buffer.data() + (idx - m_blockStart) * sizeof(T));
+    }
+
+  private:
+    static const size_t BLOCK_SIZE = 64*1024;
+    const Reader& m_reader;
+    const size_t m_count;
+    size_t m_blockStart;
+    size_t m_blockSize;
+    std::vector<char> m_buffer;
+};
+
+// Minimum number of items checked by a thread.
+const entry_index_type MIN_CHECK_RANGE_SIZE = 16*1024;
+
+// Check the items [0, count) by splitting them in ranges checked in
+// parallel by the threads of `pool`.
+// `makeChecker(begin, end)` must return a functor checking the range
+// [begin, end), item by item, in order. The functor returns false (and writes
+// the problem in the given stream) for an invalid item.
+// Only the problem of the first invalid item is reported to `err`, as if
+// the items were checked one after the other.
+// The check stops (and returns false) as soon as `cancelled()` returns true.
+template<typename MakeChecker>
+bool checkByRanges(entry_index_type count, std::ostream& err, ThreadPool& pool,
+                   const FileImpl::CancelledCallback& cancelled, MakeChecker makeChecker)
+{
+  const entry_index_type nbRanges = std::max<entry_index_type>(1,
+    std::min<entry_index_type>(pool.size(), count / MIN_CHECK_RANGE_SIZE));
+
+  // Ranges after an invalid one can stop, their problems would not be reported.
+  std::atomic<entry_index_type> firstInvalidRange(nbRanges);
+  std::vector<std::future<std::string>> results;
+  for (entry_index_type r = 0; r < nbRanges; ++r) {
+    const entry_index_type begin = uint64_t(count) * r / nbRanges;
+    const entry_index_type end = uint64_t(count) * (r+1) / nbRanges;
+    results.push_back(pool.submit([=, &firstInvalidRange, &cancelled]() {
+      auto check = makeChecker(begin, end);
+      std::ostringstream problem;
+      for (auto i = begin; i < end && firstInvalidRange.load() > r && !cancelled(); ++i) {
+        if (!check(i, problem)) {
+          auto current = firstInvalidRange.load();
+          while (current > r && !firstInvalidRange.compare_exchange_weak(current, r)) {}
+          return problem.str();
+        }
+      }
+      return std::string();
+    }));
+  }
+
+  for (auto& result: results) {
+    pool.wait(result);
+  }
+  if (cancelled()) {
+    return false;
+  }
+  for (auto& result: results) {
+    const auto problem = result.get();
+    if (!problem.empty()) {
+      err << problem;
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string pseudoTitle(const Dirent& d)
+{
+  return std::string(1, d.getNamespace()) + '/' + d.getTitle();
+}
+
+} // unnamed namespace
+
+  bool FileImpl::checkChecksum(std::ostream& err, ThreadPool& /*pool*/, const CancelledCallback& cancelled) {
+    // Thrown (between two blocks) to stop computing the checksum.
+    struct Cancelled {};
+    try {
+      if ( ! verify([&cancelled](size_type, size_type) { if (cancelled()) throw Cancelled(); }) ) {
+          err << "Checksum doesn't match" << std::endl;
+          return false;
+      }
+    } catch (const Cancelled&) {
+      return false;
     }
     return true;
   }
 
-  bool FileImpl::checkDirentPtrs() {
+  bool FileImpl::checkDirentPtrs(std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled) {
     const entry_index_type articleCount = getCountArticles().v;
     const offset_t validDirentRangeStart(80); // XXX: really???
     const offset_t validDirentRangeEnd = header.hasChecksum()
                                        ? offset_t(header.getChecksumPos())
                                        : offset_t(zimReader->size().v);
     const zsize_t direntMinSize(11);
-    for ( entry_index_type i = 0; i < articleCount; ++i )
-    {
-      const auto offset = readOffset(*urlPtrOffsetReader, i);
-      if ( offset < validDirentRangeStart ||
-           offset + direntMinSize > validDirentRangeEnd ) {
-        std::cerr << "Invalid dirent pointer" << std::endl;
-        return false;
-      }
-    }
-    return true;
-  }
-
-  bool FileImpl::checkDirentOrder() {
+    return checkByRanges(articleCount, err, pool, cancelled, [&](entry_index_type, entry_index_type) {
+      std::shared_ptr<IntegerTableReader<offset_type>> urlPtrs(
+        new IntegerTableReader<offset_type>(*urlPtrOffsetReader));
+      return [=](entry_index_type i, std::ostream& problem) {
+        const offset_t offset(urlPtrs->get(i));
+        if ( offset < validDirentRangeStart ||
+             offset + direntMinSize > validDirentRangeEnd ) {
+          problem << "Invalid dirent pointer" << std::endl;
+          return false;
+        }
+        return true;
+      };
+    });
+  }
+
+  bool FileImpl::checkDirentOrder(std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled) {
     const entry_index_type articleCount = getCountArticles().v;
-    std::shared_ptr<const Dirent> prevDirent;
-    for ( entry_index_type i = 0; i < articleCount; ++i )
-    {
-      const auto offset = readOffset(*urlPtrOffsetReader, i);
-      const std::shared_ptr<const Dirent> dirent = readDirent(offset);
-      if ( prevDirent && !(prevDirent->getLongUrl() < dirent->getLongUrl()) )
-      {
-        std::cerr << "Dirent table is not properly sorted:\n"
+    return checkByRanges(articleCount, err, pool, cancelled, [&](entry_index_type begin, entry_index_type) {
+      struct State {
+        explicit State(const Reader& reader) : urlPtrs(reader) {}
+        IntegerTableReader<offset_type> urlPtrs;
+        std::vector<char> buffer;
+        std::shared_ptr<const Dirent> prevDirent;
+      };
+      std::shared_ptr<State> state(new State(*urlPtrOffsetReader));
+      if (begin > 0) {
+        // The boundary with the previous range.
+        state->prevDirent = readDirent(offset_t(state->urlPtrs.get(begin-1)), state->buffer);
+      }
+      return [=](entry_index_type i, std::ostream& problem) {
+        const offset_t offset(state->urlPtrs.get(i));
+        const auto dirent = readDirent(offset, state->buffer);
+        const auto& prevDirent = state->prevDirent;
+        if ( prevDirent && !(prevDirent->getLongUrl() < dirent->getLongUrl()) )
+        {
+          problem << "Dirent table is not properly sorted:\n"
                   << "  #" << i-1 << ": " << prevDirent->getLongUrl() << "\n"
                   << "  #" << i   << ": " << dirent->getLongUrl() << std::endl;
-        return false;
-      }
-      prevDirent = dirent;
-    }
-    return true;
+          return false;
+        }
+        state->prevDirent = dirent;
+        return true;
+      };
+    });
   }
 
-  bool FileImpl::checkClusterPtrs() {
+  bool FileImpl::checkClusterPtrs(std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled) {
     const cluster_index_type clusterCount = getCountClusters().v;
     const offset_t validClusterRangeStart(80); // XXX: really???
     const offset_t validClusterRangeEnd = header.hasChecksum()
                                        ? offset_t(header.getChecksumPos())
                                        : offset_t(zimReader->size().v);
     const zsize_t clusterMinSize(1); // XXX
-    for ( cluster_index_type i = 0; i < clusterCount; ++i )
-    {
-      const auto offset = readOffset(*clusterOffsetReader, i);
-      if ( offset < validClusterRangeStart ||
-           offset + clusterMinSize > validClusterRangeEnd ) {
-        std::cerr << "Invalid cluster pointer" << std::endl;
-        return false;
-      }
-    }
-    return true;
-  }
-
-namespace
-{
-
-std::string pseudoTitle(const Dirent& d)
-{
-  return std::string(1, d.getNamespace()) + '/' + d.getTitle();
-}
-
-} // unnamed namespace
-
-  bool FileImpl::checkTitleIndex() {
+    return checkByRanges(clusterCount, err, pool, cancelled, [&](cluster_index_type, cluster_index_type) {
+      std::shared_ptr<IntegerTableReader<offset_type>> clusterPtrs(
+        new IntegerTableReader<offset_type>(*clusterOffsetReader));
+      return [=](cluster_index_type i, std::ostream& problem) {
+        const offset_t offset(clusterPtrs->get(i));
+        if ( offset < validClusterRangeStart ||
+             offset + clusterMinSize > validClusterRangeEnd ) {
+          problem << "Invalid cluster pointer" << std::endl;
+          return false;
+        }
+        return true;
+      };
+    });
+  }
+
+  bool FileImpl::checkTitleIndex(std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled) {
     const entry_index_type articleCount = getCountArticles().v;
-    std::shared_ptr<const Dirent> prevDirent;
-    for ( entry_index_type i = 0; i < articleCount; ++i )
-    {
-      const offset_t offset(i*sizeof(entry_index_t));
-      const auto a = titleIndexReader->read_uint<entry_index_type>(offset);
-      if ( a >= articleCount ) {
-        std::cerr << "Invalid title index entry" << std::endl;
-        return false;
+    return checkByRanges(articleCount, err, pool, cancelled, [&](entry_index_type begin, entry_index_type) {
+      struct State {
+        explicit State(const Reader& reader) : titles(reader) {}
+        IntegerTableReader<entry_index_type> titles;
+        std::vector<char> buffer;
+        std::shared_ptr<const Dirent> prevDirent;
+      };
+      std::shared_ptr<State> state(new State(*titleIndexReader));
+      if (begin > 0) {
+        // The boundary with the previous range.
+        // An invalid entry is reported by the previous range.
+        const auto a = state->titles.get(begin-1);
+        if ( a < articleCount ) {
+          state->prevDirent = readDirent(readOffset(*urlPtrOffsetReader, a), state->buffer);
+        }
       }
-      const auto direntOffset = readOffset(*urlPtrOffsetReader, a);
-      const std::shared_ptr<const Dirent> dirent = readDirent(direntOffset);
-      if ( prevDirent && !(pseudoTitle(*prevDirent) <= pseudoTitle(*dirent)) )
-      {
-        std::cerr << "Title index is not properly sorted:\n"
+      return [=](entry_index_type i, std::ostream& problem) {
+        const auto a = state->titles.get(i);
+        if ( a >= articleCount ) {
+          problem << "Invalid title index entry" << std::endl;
+          return false;
+        }
+        const auto direntOffset = readOffset(*urlPtrOffsetReader, a);
+        const auto dirent = readDirent(direntOffset, state->buffer);
+        const auto& prevDirent = state->prevDirent;
+        if ( prevDirent && !(pseudoTitle(*prevDirent) <= pseudoTitle(*dirent)) )
+        {
+          problem << "Title index is not properly sorted:\n"
                   << "  #" << i-1 << ": " << pseudoTitle(*prevDirent) << "\n"
                   << "  #" << i   << ": " << pseudoTitle(*dirent) << std::endl;
-        return false;
-      }
-      prevDirent = dirent;
-    }
-    return true;
+          return false;
+        }
+        state->prevDirent = dirent;
+        return true;
+      };
+    });
   }
 }
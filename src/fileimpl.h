@@ -20,6 +20,8 @@
 #ifndef ZIM_FILEIMPL_H
 #define ZIM_FILEIMPL_H
 
+#include <functional>
+#include <iosfwd>
 #include <string>
 #include <vector>
 #include <map>
@@ -35,10 +37,13 @@
 #include "file_reader.h"
 #include "file_compound.h"
 #include "fileheader.h"
+#include "checksum.h"
 #include "zim_types.h"
 
 namespace zim
 {
+  class ThreadPool;
+
   class FileImpl
   {
       std::shared_ptr<FileCompound> zimFile;
@@ -101,6 +106,7 @@ namespace zim
       std::shared_ptr<const Cluster> getCluster(cluster_index_t idx);
       cluster_index_t getCountClusters() const       { return cluster_index_t(header.getClusterCount()); }
       offset_t getClusterOffset(cluster_index_t idx) const;
+      offset_t getDirentOffset(entry_index_t idx) const;
       offset_t getBlobOffset(cluster_index_t clusterIdx, blob_index_t blobIdx);
 
       entry_index_t getNamespaceBeginOffset(char ch);
@@ -118,23 +124,30 @@ namespace zim
       const std::string& getMimeType(uint16_t idx) const;
 
       std::string getChecksum();
-      bool verify();
+      bool verify(const ProgressCallback& progress = nullptr);
       bool is_multiPart() const;
 
       bool checkIntegrity(IntegrityCheck checkType);
+      // Same as `checkIntegrity(checkType)` but the problems found are
+      // written to `err` instead of stderr and the check is run by the
+      // threads of `pool`. It stops early (returning false) as soon as
+      // `cancelled()` returns true.
+      typedef std::function<bool()> CancelledCallback;
+      bool checkIntegrity(IntegrityCheck checkType, std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled);
   private:
       DirentLookup& direntLookup();
       ClusterHandle readCluster(cluster_index_t idx);
       std::shared_ptr<const Dirent> readDirent(offset_t offset);
+      std::shared_ptr<const Dirent> readDirent(offset_t offset, std::vector<char>& buffer) const;
       offset_type getMimeListEndUpperLimit() const;
       void readMimeTypes();
       void quickCheckForCorruptFile();
 
-      bool checkChecksum();
-      bool checkDirentPtrs();
-      bool checkDirentOrder();
-      bool checkTitleIndex();
-      bool checkClusterPtrs();
+      bool checkChecksum(std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled);
+      bool checkDirentPtrs(std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled);
+      bool checkDirentOrder(std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled);
+      bool checkTitleIndex(std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled);
+      bool checkClusterPtrs(std::ostream& err, ThreadPool& pool, const CancelledCallback& cancelled);
   };
 
 }
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_FRAMES_READER_H
+#define ZIM_FRAMES_READER_H
+
+#include "reader.h"
+#include "decoderstreamreader.h"
+
+#include <mutex>
+#include <vector>
+#include <cstring>
+
+namespace zim
+{
+
+// A FrameIndex describes a stream of independently compressed frames.
+// All frames but the last one decompress to `frameSize` bytes.
+struct FrameIndex
+{
+  zsize_t frameSize;
+  zsize_t dataSize;
+
+  // Offsets of the frames in the compressed stream.
+  // For N frames, this collection contains N+1 entries.
+  std::vector<offset_t> offsets;
+
+  size_t frameCount() const { return offsets.size() - 1; }
+};
+
+// FramesReader gives random access to data compressed as a sequence of
+// independent frames. Only the frames covering the requested range are
+// decompressed; the last decompressed frame is kept around as sequential
+// reads usually hit it again.
+template<typename Decoder>
+class FramesReader : public Reader
+{
+  private: // types
+    struct Frames
+    {
+      Frames(std::shared_ptr<const Reader> source, FrameIndex index)
+        : source(source),
+          index(std::move(index)),
+          cachedFrame(this->index.frameCount()),
+          cachedData(Buffer::makeBuffer(zsize_t(0)))
+      {}
+
+      zsize_t getFrameSize(size_t n) const
+      {
+        auto start = index.frameSize.v * n;
+        return zsize_t(std::min(index.frameSize.v, index.dataSize.v - start));
+      }
+
+      const Buffer getFrame(size_t n)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (n != cachedFrame) {
+          const auto start = index.offsets[n];
+          const auto compressedSize = zsize_t(index.offsets[n+1].v - start.v);
+          std::shared_ptr<const Reader> frameReader(source->sub_reader(start, compressedSize));
+          DecoderStreamReader<Decoder> decoder(frameReader);
+          cachedData = decoder.sub_reader(getFrameSize(n))->get_buffer(offset_t(0));
+          cachedFrame = n;
+        }
+        return cachedData;
+      }
+
+      std::shared_ptr<const Reader> source;
+      const FrameIndex index;
+      std::mutex mutex;
+      size_t cachedFrame;
+      Buffer cachedData;
+    };
+
+  public: // functions
+    FramesReader(std::shared_ptr<const Reader> source, FrameIndex index)
+      : m_frames(std::make_shared<Frames>(source, std::move(index))),
+        m_offset(0),
+        m_size(m_frames->index.dataSize)
+    {}
+
+    zsize_t size() const { return m_size; }
+    offset_t offset() const { return m_offset; }
+
+    void read(char* dest, offset_t offset, zsize_t size) const
+    {
+      ASSERT(offset.v+size.v, <=, m_size.v);
+      offset += m_offset;
+      const auto frameSize = m_frames->index.frameSize.v;
+      while (size.v) {
+        const auto n = offset.v / frameSize;
+        const auto frame = m_frames->getFrame(n);
+        const auto local_offset = offset.v - n * frameSize;
+        const auto to_copy = std::min(size.v, frame.size().v - local_offset);
+        memcpy(dest, frame.data(offset_t(local_offset)), to_copy);
+        dest += to_copy;
+        offset.v += to_copy;
+        size.v -= to_copy;
+      }
+    }
+
+    char read(offset_t offset) const
+    {
+      char ret;
+      read(&ret, offset, zsize_t(1));
+      return ret;
+    }
+
+    const Buffer get_buffer(offset_t offset, zsize_t size) const
+    {
+      ASSERT(offset.v+size.v, <=, m_size.v);
+      const auto frameSize = m_frames->index.frameSize.v;
+      const auto start = m_offset.v + offset.v;
+      const auto n = start / frameSize;
+      if (size.v && n == (start + size.v - 1) / frameSize) {
+        // Fully inside one frame, no need to copy.
+        return m_frames->getFrame(n).sub_buffer(offset_t(start - n * frameSize), size);
+      }
+      auto buffer = Buffer::makeBuffer(size);
+      read(const_cast<char*>(buffer.data()), offset, size);
+      return buffer;
+    }
+
+    std::unique_ptr<const Reader> sub_reader(offset_t offset, zsize_t size) const
+    {
+      ASSERT(offset.v+size.v, <=, m_size.v);
+      return std::unique_ptr<const Reader>(
+        new FramesReader(m_frames, m_offset + offset, size));
+    }
+
+  private: // functions
+    FramesReader(std::shared_ptr<Frames> frames, offset_t offset, zsize_t size)
+      : m_frames(frames),
+        m_offset(offset),
+        m_size(size)
+    {}
+
+  private: // data
+    std::shared_ptr<Frames> m_frames;
+    offset_t m_offset;
+    zsize_t m_size;
+};
+
+} // namespace zim
+
+#endif // ZIM_FRAMES_READER_H
@@ -17,6 +17,7 @@
  *
  */
 
+#include "config.h"
 #include "fs_unix.h"
 #include <stdexcept>
 
@@ -27,6 +28,10 @@
 #include <dirent.h>
 #include <errno.h>
 
+#if defined(HAVE_SENDFILE)
+# include <sys/sendfile.h>
+#endif
+
 namespace zim
 {
 
@@ -63,6 +68,40 @@ zsize_t FD::getSize() const
   return zsize_t(sb.st_size);
 }
 
+void FD::adviseSequential() const
+{
+#if defined(POSIX_FADV_SEQUENTIAL)
+  posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+zsize_t FD::copyTo(int out_fd, offset_t offset, zsize_t size) const
+{
+  size_type copied = 0;
+#if defined(HAVE_COPY_FILE_RANGE)
+  // Not supported by all the kernels and filesystems, sendfile is tried next.
+  loff_t in_offset = offset.v;
+  while (copied < size.v) {
+    auto ret = copy_file_range(m_fd, &in_offset, out_fd, nullptr, size.v - copied, 0);
+    if (ret <= 0) {
+      break;
+    }
+    copied += ret;
+  }
+#endif
+#if defined(HAVE_SENDFILE)
+  off_t sendfile_offset = offset.v + copied;
+  while (copied < size.v) {
+    auto ret = sendfile(out_fd, m_fd, &sendfile_offset, size.v - copied);
+    if (ret <= 0) {
+      break;
+    }
+    copied += ret;
+  }
+#endif
+  return zsize_t(copied);
+}
+
 bool FD::seek(offset_t offset)
 {
     return static_cast<int64_t>(offset.v) == lseek(m_fd, offset.v, SEEK_SET);
@@ -58,6 +58,12 @@ class FD {
     ~FD() { close(); }
     zsize_t readAt(char* dest, zsize_t size, offset_t offset) const;
     zsize_t getSize() const;
+    // Hint the system that the file will be read sequentially.
+    void    adviseSequential() const;
+    // Copy `size` bytes at `offset` to the current position of `out_fd`
+    // without going through the user space (if the system can do it).
+    // Return the number of bytes copied, the caller must copy the rest.
+    zsize_t copyTo(int out_fd, offset_t offset, zsize_t size) const;
     fd_t    getNativeHandle() const
     {
         return m_fd;
@@ -94,6 +94,17 @@ err:
   return zsize_t(-1);
 }
 
+void FD::adviseSequential() const
+{
+  // Sequential access can only be requested when opening the file.
+}
+
+zsize_t FD::copyTo(int out_fd, offset_t offset, zsize_t size) const
+{
+  // No in-kernel copy between a HANDLE and a crt file descriptor.
+  return zsize_t(0);
+}
+
 bool FD::seek(offset_t offset)
 {
   if(!mp_impl)
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include "sha256.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace zim
+{
+
+namespace
+{
+
+const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32_t rotr(uint32_t x, unsigned n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+} // unnamed namespace
+
+Sha256::Sha256()
+  : m_state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}
+{}
+
+void Sha256::update(const char* data, size_t size)
+{
+  size_t used = m_size % 64;
+  m_size += size;
+  if (used) {
+    const size_t n = std::min<size_t>(64 - used, size);
+    memcpy(m_buffer + used, data, n);
+    data += n;
+    size -= n;
+    if (used + n < 64) {
+      return;
+    }
+    transform(m_buffer);
+  }
+  for (; size >= 64; data += 64, size -= 64) {
+    transform(reinterpret_cast<const unsigned char*>(data));
+  }
+  memcpy(m_buffer, data, size);
+}
+
+void Sha256::final(unsigned char digest[DIGEST_SIZE])
+{
+  const uint64_t bitSize = m_size * 8;
+  const char padding[64] = { char(0x80) };
+  const size_t used = m_size % 64;
+  update(padding, used < 56 ? 56 - used : 120 - used);
+  char sizeBytes[8];
+  for (unsigned i = 0; i < 8; ++i) {
+    sizeBytes[i] = char(bitSize >> (56 - 8*i));
+  }
+  update(sizeBytes, 8);
+  for (unsigned i = 0; i < 8; ++i) {
+    for (unsigned j = 0; j < 4; ++j) {
+      digest[4*i + j] = (unsigned char)(m_state[i] >> (24 - 8*j));
+    }
+  }
+}
+
+void Sha256::transform(const unsigned char block[64])
+{
+  uint32_t w[64];
+  for (unsigned i = 0; i < 16; ++i) {
+    w[i] = (uint32_t(block[4*i]) << 24) | (uint32_t(block[4*i+1]) << 16)
+         | (uint32_t(block[4*i+2]) << 8) | uint32_t(block[4*i+3]);
+  }
+  for (unsigned i = 16; i < 64; ++i) {
+    const uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+    const uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+
+  uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+  uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+  for (unsigned i = 0; i < 64; ++i) {
+    const uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+    const uint32_t ch = (e & f) ^ (~e & g);
+    const uint32_t t1 = h + s1 + ch + K[i] + w[i];
+    const uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+    const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    const uint32_t t2 = s0 + maj;
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+  m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+}
+
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_SHA256_H
+#define ZIM_SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zim
+{
+
+// Incremental computation of the SHA-256 of some data (FIPS 180-4).
+class Sha256
+{
+  public:
+    static const size_t DIGEST_SIZE = 32;
+
+    Sha256();
+
+    void update(const char* data, size_t size);
+    // Write the digest of the data in `digest`. The object must not be
+    // updated afterwards.
+    void final(unsigned char digest[DIGEST_SIZE]);
+
+  private:
+    void transform(const unsigned char block[64]);
+
+    uint32_t m_state[8];
+    uint64_t m_size = 0;
+    unsigned char m_buffer[64];
+};
+
+}
+
+#endif // ZIM_SHA256_H
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_THREAD_POOL_H
+#define ZIM_THREAD_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zim
+{
+
+// A fixed number of threads running tasks.
+//
+// A task may submit other tasks and wait for them with `wait`: the waiting
+// thread runs the pending tasks meanwhile, so tasks waiting for other tasks
+// don't block the threads of the pool. A task must only wait for the tasks
+// it submitted: any pending task may be run on top of the waiting one.
+class ThreadPool
+{
+  public:
+    explicit ThreadPool(unsigned nbThreads)
+    {
+      for (unsigned i = 0; i < nbThreads; ++i) {
+        m_threads.emplace_back(&ThreadPool::run, this);
+      }
+    }
+
+    // Run the pending tasks and stop the threads.
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_stopping = true;
+      }
+      m_cond.notify_all();
+      for (auto& thread: m_threads) {
+        thread.join();
+      }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return m_threads.size(); }
+
+    template<typename F>
+    std::future<decltype(std::declval<F>()())> submit(F f)
+    {
+      typedef decltype(f()) R;
+      auto task = std::make_shared<std::packaged_task<R()>>(std::move(f));
+      auto future = task->get_future();
+      {
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_tasks.push_back([task]() { (*task)(); });
+      }
+      m_cond.notify_all();
+      return future;
+    }
+
+    // Wait for `future` (a future of a task of this pool), running the
+    // pending tasks meanwhile.
+    template<typename Future>
+    void wait(const Future& future)
+    {
+      std::unique_lock<std::mutex> l(m_mutex);
+      while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        if (!m_tasks.empty()) {
+          runTask(l);
+        } else {
+          m_cond.wait(l);
+        }
+      }
+    }
+
+  private:
+    void run()
+    {
+      std::unique_lock<std::mutex> l(m_mutex);
+      while (true) {
+        if (!m_tasks.empty()) {
+          runTask(l);
+        } else if (m_stopping) {
+          return;
+        } else {
+          m_cond.wait(l);
+        }
+      }
+    }
+
+    // Run the first pending task. `l` must be locked, it is unlocked
+    // while the task runs.
+    void runTask(std::unique_lock<std::mutex>& l)
+    {
+      auto task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+      l.unlock();
+      task();
+      task = nullptr;
+      l.lock();
+      // Wake up the threads waiting for this task.
+      m_cond.notify_all();
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stopping = false;
+};
+
+}
+
+#endif // ZIM_THREAD_POOL_H
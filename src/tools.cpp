@@ -60,12 +60,26 @@ bool zim::isCompressibleMimetype(const std::string& mimetype)
 
 #include <unicode/translit.h>
 #include <unicode/ucnv.h>
+namespace
+{
+icu::Transliterator* createRemoveAccentsTransliterator()
+{
+  UErrorCode status = U_ZERO_ERROR;
+  std::unique_ptr<icu::Transliterator> transliterator(icu::Transliterator::createInstance(
+      "Lower; NFD; [:M:] remove; NFC", UTRANS_FORWARD, status));
+  if (U_FAILURE(status) || !transliterator) {
+    throw std::runtime_error(std::string("Cannot create the transliterator removing accents: ")
+                             + u_errorName(status));
+  }
+  return transliterator.release();
+}
+}
+
 std::string zim::removeAccents(const std::string& text)
 {
   ucnv_setDefaultName("UTF-8");
-  static UErrorCode status = U_ZERO_ERROR;
-  static std::unique_ptr<icu::Transliterator> removeAccentsTrans(icu::Transliterator::createInstance(
-      "Lower; NFD; [:M:] remove; NFC", UTRANS_FORWARD, status));
+  // Transliterators are not thread safe, each (indexing) thread has its own.
+  thread_local std::unique_ptr<icu::Transliterator> removeAccentsTrans(createRemoveAccentsTransliterator());
   icu::UnicodeString ustring(text.c_str());
   removeAccentsTrans->transliterate(ustring);
   std::string unaccentedText;
@@ -24,6 +24,11 @@
 
 #include "debug.h"
 
+#include <algorithm>
+#include <cstring>
+#include <iosfwd>
+#include <string>
+
 namespace zim
 {
   namespace writer {
@@ -52,52 +57,85 @@ namespace zim
         static const uint32_t version = 0;
 
         uint16_t mimeType;
-        DirentInfo info {};
         char ns;
-        std::string path;
-        std::string title;
-        Cluster* cluster = nullptr;
         char redirectNs;
-        std::string redirectPath;
+        bool removed = false;
+        // The path, the title and the redirect path are stored one after
+        // the other (each one followed by a '\0') in `strings`. This block
+        // is in the string arena of the DirentPool for the dirents of a
+        // pool (it is released with the pool), else it is owned by the
+        // dirent.
+        bool ownStrings = false;
+        uint32_t pathSize = 0;
+        uint32_t titleSize = 0;
+        uint32_t redirectPathSize = 0;
+        const char* strings = nullptr;
+        DirentInfo info {};
+        Cluster* cluster = nullptr;
         entry_index_t idx = entry_index_t(0);
         offset_t offset;
 
+        const char* pathData() const          { return strings ? strings : ""; }
+        const char* titleData() const         { return strings ? strings + pathSize + 1 : ""; }
+        const char* redirectPathData() const  { return strings ? strings + pathSize + titleSize + 2 : ""; }
+        // The title, or the path if the title is empty.
+        const char* displayTitleData() const  { return titleSize ? titleData() : pathData(); }
+        uint32_t displayTitleSize() const     { return titleSize ? titleSize : pathSize; }
+
+        static size_t stringsSize(const std::string& path, const std::string& title, const std::string& redirectPath)
+        { return path.size() + title.size() + redirectPath.size() + 3; }
+        void copyStrings(char* dest, const std::string& path, const std::string& title, const std::string& redirectPath);
+        void releaseStrings();
+
+        friend class DirentPool;
+
       public:
         Dirent()
           : mimeType(0),
             ns(),
-            path(),
-            title(),
-            redirectNs(),
-            redirectPath()
+            redirectNs()
         {
           info.d.clusterNumber = cluster_index_t(0);
           info.d.blobNumber = blob_index_t(0);
         }
 
-        explicit Dirent(char ns_, std::string path_ )
+        explicit Dirent(char ns_, const std::string& path_ )
           : Dirent()
-          { ns = ns_; path = path_; }
+          { ns = ns_; setPath(path_); }
+
+        Dirent(const Dirent& other);
+        Dirent(Dirent&& other);
+        Dirent& operator=(Dirent other);
+        ~Dirent() { releaseStrings(); }
+        void swap(Dirent& other);
 
         char getNamespace() const               { return ns; }
         void setNamespace(char ns_)              { ns = ns_; }
-        const std::string& getTitle() const     { return title.empty() ? path : title; }
-        void setTitle(const std::string& title_) { title = title_; }
-        const std::string& getPath() const       { return path; }
+        std::string getTitle() const            { return std::string(displayTitleData(), displayTitleSize()); }
+        void setTitle(const std::string& title_) { setStrings(getPath(), title_, getRedirectPath()); }
+        std::string getPath() const              { return std::string(pathData(), pathSize); }
+        // The path without copying it (for comparisons).
+        const char* getPathData() const          { return pathData(); }
+        uint32_t getPathSize() const             { return pathSize; }
         void setPath(const std::string& path_) {
-          path = path_;
+          setStrings(path_, std::string(titleData(), titleSize), getRedirectPath());
         }
+        // Set all the strings at once (the dirent owns them).
+        void setStrings(const std::string& path_, const std::string& title_, const std::string& redirectPath_);
 
         uint32_t getVersion() const            { return version; }
 
         void setRedirectNs(char redirectNs_)      { redirectNs = redirectNs_; }
-        char getRedirectNs() { return redirectNs; }
-        void setRedirectPath(const std::string& redirectPath_)     { redirectPath = redirectPath_; }
-        const std::string& getRedirectPath() const         { return redirectPath; }
+        char getRedirectNs() const { return redirectNs; }
+        void setRedirectPath(const std::string& redirectPath_) {
+          setStrings(getPath(), std::string(titleData(), titleSize), redirectPath_);
+        }
+        std::string getRedirectPath() const         { return std::string(redirectPathData(), redirectPathSize); }
         void setRedirect(const Dirent* target) {
           info.r.redirectDirent = target;
           mimeType = redirectMimeType;
         }
+        const Dirent* getRedirectDirent() const     { return info.r.redirectDirent; }
         entry_index_t getRedirectIndex() const      { return isRedirect() ? info.r.redirectDirent->getIdx() : entry_index_t(0); }
 
         void setMimeType(uint16_t mime)
@@ -105,6 +143,11 @@ namespace zim
           mimeType = mime;
         }
 
+        // A removed dirent (duplicated url, invalid redirection) is not
+        // written in the archive.
+        void markRemoved()                   { removed = true; }
+        bool isRemoved() const               { return removed; }
+
         void setIdx(entry_index_t idx_)      { idx = idx_; }
         entry_index_t getIdx() const         { return idx; }
 
@@ -116,6 +159,14 @@ namespace zim
           info.d.blobNumber = _cluster->count();
         }
 
+        // Point to a blob already added to a cluster.
+        void setCluster(zim::writer::Cluster* _cluster, blob_index_t blobNumber)
+        {
+          ASSERT(isItem(), ==, true);
+          cluster = _cluster;
+          info.d.blobNumber = blobNumber;
+        }
+
         cluster_index_t getClusterNumber() const {
           return cluster ? cluster->getClusterIndex() : info.d.clusterNumber;
         }
@@ -128,9 +179,9 @@ namespace zim
         uint16_t getMimeType() const            { return mimeType; }
         size_t getDirentSize() const
         {
-          size_t ret = (isRedirect() ? 12 : 16) + path.size() + 2;
-          if (title != path)
-            ret += title.size();
+          size_t ret = (isRedirect() ? 12 : 16) + pathSize + 2;
+          if (!hasPathAsTitle())
+            ret += titleSize;
           return ret;
         }
 
@@ -145,21 +196,42 @@ namespace zim
           info.d.blobNumber = blobNumber_;
         }
 
-        void write(int out_fd) const;
+        // Serialize the dirent in `dest`, which must be getDirentSize() bytes long.
+        void serialize(char* dest) const;
+
+        // (De)serialization in temporary files (see ExternalDirents).
+        // The dirent must be resolved (cluster index known) before dump.
+        void dump(std::ostream& out) const;
+        bool load(std::istream& in);
+        size_t memorySize() const
+        { return sizeof(Dirent) + pathSize + titleSize + redirectPathSize + 3; }
 
         friend bool compareUrl(const Dirent* d1, const Dirent* d2);
         friend inline bool compareTitle(const Dirent* d1, const Dirent* d2);
+
+      private:
+        // The title is not written if it is the same as the path.
+        bool hasPathAsTitle() const
+        { return titleSize == pathSize && std::memcmp(titleData(), pathData(), pathSize) == 0; }
     };
 
+    // Lexicographical comparison of two byte strings, as std::string does.
+    inline bool lessBytes(const char* s1, size_t size1, const char* s2, size_t size2)
+    {
+      const int r = std::memcmp(s1, s2, std::min(size1, size2));
+      return r < 0 || (r == 0 && size1 < size2);
+    }
 
     inline bool compareUrl(const Dirent* d1, const Dirent* d2)
     {
-      return d1->ns < d2->ns || (d1->ns == d2->ns && d1->path < d2->path);
+      return d1->ns < d2->ns
+        || (d1->ns == d2->ns && lessBytes(d1->pathData(), d1->pathSize, d2->pathData(), d2->pathSize));
     }
     inline bool compareTitle(const Dirent* d1, const Dirent* d2)
     {
       return d1->ns < d2->ns
-        || (d1->ns == d2->ns && d1->getTitle() < d2->getTitle());
+        || (d1->ns == d2->ns && lessBytes(d1->displayTitleData(), d1->displayTitleSize(),
+                                          d2->displayTitleData(), d2->displayTitleSize()));
     }
   }
 }
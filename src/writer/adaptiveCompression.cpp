@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include "adaptiveCompression.h"
+#include "queue.h"
+
+namespace zim
+{
+  namespace writer
+  {
+    AdaptiveCompressionLevel::AdaptiveCompressionLevel(int minLevel, int maxLevel, double targetMBps, unsigned nbWorkers)
+      : m_minLevel(minLevel),
+        m_maxLevel(maxLevel),
+        m_targetMBps(targetMBps),
+        m_nbWorkers(nbWorkers ? nbWorkers : 1),
+        m_level((minLevel + maxLevel) / 2),
+        m_levelMBps(maxLevel + 1, 0.0)
+    {}
+
+    double AdaptiveCompressionLevel::estimatedMBps(int level) const
+    {
+      return m_levelMBps[level] * m_nbWorkers;
+    }
+
+    int AdaptiveCompressionLevel::nextLevel(size_t pendingTasks)
+    {
+      std::lock_guard<std::mutex> l(m_mutex);
+      const auto current = estimatedMBps(m_level);
+      if (current == 0) {
+        // Nothing measured yet for this level, keep it.
+        return m_level;
+      }
+      if (current < m_targetMBps || pendingTasks >= MAX_QUEUE_SIZE) {
+        if (m_level > m_minLevel) {
+          --m_level;
+        }
+      } else if (m_level < m_maxLevel && pendingTasks <= 1) {
+        const auto next = estimatedMBps(m_level + 1);
+        if (next == 0 || next >= m_targetMBps) {
+          ++m_level;
+        }
+      }
+      return m_level;
+    }
+
+    void AdaptiveCompressionLevel::report(int level, zsize_t rawSize, double seconds)
+    {
+      if (level < m_minLevel || level > m_maxLevel || seconds <= 0) {
+        return;
+      }
+      const double mbps = rawSize.v / seconds / (1024*1024);
+      std::lock_guard<std::mutex> l(m_mutex);
+      auto& measured = m_levelMBps[level];
+      measured = measured == 0 ? mbps : 0.7 * measured + 0.3 * mbps;
+    }
+  }
+}
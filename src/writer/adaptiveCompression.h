@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_WRITER_ADAPTIVECOMPRESSION_H
+#define ZIM_WRITER_ADAPTIVECOMPRESSION_H
+
+#include <mutex>
+#include <vector>
+
+#include "../zim_types.h"
+
+namespace zim
+{
+  namespace writer
+  {
+    /**
+     * Choose the compression level of each cluster to keep the compression
+     * throughput (of all the workers together) around a target.
+     *
+     * The throughput of each level is measured on the compressed clusters.
+     * The level is lowered when the throughput of the current level is under
+     * the target or when compression tasks pile up in the queue.
+     * It is raised when the workers are idle and the next level is not known
+     * to be too slow.
+     */
+    class AdaptiveCompressionLevel
+    {
+      public:
+        AdaptiveCompressionLevel(int minLevel, int maxLevel, double targetMBps, unsigned nbWorkers);
+
+        int nextLevel(size_t pendingTasks);
+        void report(int level, zsize_t rawSize, double seconds);
+
+      private:
+        double estimatedMBps(int level) const;
+
+        std::mutex m_mutex;
+        const int m_minLevel;
+        const int m_maxLevel;
+        const double m_targetMBps;
+        const unsigned m_nbWorkers;
+        int m_level;
+        // Measured throughput of one worker for each level (0 if unknown).
+        std::vector<double> m_levelMBps;
+    };
+  }
+}
+
+#endif // ZIM_WRITER_ADAPTIVECOMPRESSION_H
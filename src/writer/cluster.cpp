@@ -22,13 +22,17 @@
 #include "../endian_tools.h"
 #include "../debug.h"
 #include "../compression.h"
+#include "../fs.h"
 
 #include <zim/writer/contentProvider.h>
+#include "contentProviderAccess.h"
 
 #include <sstream>
 #include <fstream>
+#include <cstring>
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <stdexcept>
 
 #ifdef _WIN32
@@ -41,9 +45,130 @@
 namespace zim {
 namespace writer {
 
-Cluster::Cluster(CompressionType compression)
+namespace
+{
+
+// Files smaller than this are copied through the write buffer, the
+// in-kernel copy is not worth an extra system call for them.
+const size_type ZERO_COPY_MIN_SIZE = 64*1024;
+
+// Gather the small writes of an uncompressed cluster (offsets and small
+// blobs) in big writes.
+class BufferedWriter
+{
+  public:
+    explicit BufferedWriter(int out_fd)
+      : m_fd(out_fd),
+        m_buffer(new char[BUFFER_SIZE]),
+        m_used(0)
+    {}
+
+    void write(const char* data, size_type size)
+    {
+      if (m_used + size > BUFFER_SIZE) {
+        flush();
+      }
+      if (size >= BUFFER_SIZE) {
+        writeAll(data, size);
+        return;
+      }
+      memcpy(m_buffer.get() + m_used, data, size);
+      m_used += size;
+    }
+
+    void flush()
+    {
+      writeAll(m_buffer.get(), m_used);
+      m_used = 0;
+    }
+
+  private:
+    void writeAll(const char* data, size_type size)
+    {
+      // The data can be pretty big (> 4Gb) and ::write fails to write data
+      // > 4Gb. So we have to chunck the write.
+      while (size) {
+        auto chunk_size = std::min<size_type>(size, WRITE_CHUNK_SIZE);
+        auto ret = _write(m_fd, data, chunk_size);
+        if (ret == -1) {
+          throw std::runtime_error("Error writing");
+        }
+        data += ret;
+        size -= ret;
+      }
+    }
+
+    static const size_type BUFFER_SIZE = 1024*1024;
+    static const size_type WRITE_CHUNK_SIZE = 1024*1024*1024;
+    int m_fd;
+    std::unique_ptr<char[]> m_buffer;
+    size_type m_used;
+};
+
+// Read the file from `offset` up to `size` and write it with `writer`.
+void readFile(const DEFAULTFS::FD& fd, const std::string& path, size_type offset, size_type size, writer_t writer)
+{
+  const size_type chunkSize = 1024*1024;
+  std::unique_ptr<char[]> buffer;
+  for (; offset < size; offset += chunkSize) {
+    const auto toRead = std::min(size - offset, chunkSize);
+    if (!buffer) {
+      buffer.reset(new char[toRead]);
+    }
+    if (fd.readAt(buffer.get(), zsize_t(toRead), offset_t(offset)).v == -1UL) {
+      throw std::runtime_error("Error reading file " + path);
+    }
+    writer(Blob(buffer.get(), toRead));
+  }
+}
+
+// Copy a file of `size` bytes to `out_fd` by the system, without reading
+// it in a user space buffer. What the system couldn't copy is read and
+// written with `writer`.
+// Return false if the system couldn't copy anything.
+bool copyFile(const std::string& path, size_type size, int out_fd, writer_t writer)
+{
+  const auto fd = DEFAULTFS::openFile(path);
+  const auto copied = fd.copyTo(out_fd, offset_t(0), zsize_t(size)).v;
+  if (!copied) {
+    return false;
+  }
+  readFile(fd, path, copied, size, writer);
+  return true;
+}
+
+// The frame index of a seekable cluster (see zim::Cluster), in a zstd
+// skippable frame put in front of the compressed frames.
+size_type frameIndexSize(size_t nbFrames)
+{
+  return 8 + 16 + 4 * nbFrames;
+}
+
+void writeFrameIndex(char* out, size_type frameSize, const std::vector<zsize_t>& frameSizes, size_type dataSize)
+{
+  toLittleEndian(ZSTD_FRAME_INDEX_MAGIC, out);
+  toLittleEndian(static_cast<uint32_t>(frameIndexSize(frameSizes.size()) - 8), out + 4);
+  toLittleEndian(static_cast<uint32_t>(frameSize), out + 8);
+  toLittleEndian(static_cast<uint32_t>(frameSizes.size()), out + 12);
+  toLittleEndian(static_cast<uint64_t>(dataSize), out + 16);
+  out += 24;
+  for (auto size: frameSizes) {
+    toLittleEndian(static_cast<uint32_t>(size.v), out);
+    out += 4;
+  }
+}
+
+}
+
+Cluster::Cluster(CompressionType compression, size_type frameSize)
   : compression(compression),
+    frameSize(frameSize),
+    compressionLevel(-1),
+    compressionThreads(1),
+    compressedSize(0),
+    index(std::numeric_limits<cluster_index_type>::max()),
     isExtended(false),
+    streamed(false),
     _size(0)
 {
   blobOffsets.push_back(offset_t(0));
@@ -53,11 +178,13 @@ Cluster::~Cluster() {
   if (compressed_data.data()) {
     delete[] compressed_data.data();
   }
+  clear_tmp_file();
 }
 
 void Cluster::clear_data() {
   clear_raw_data();
   clear_compressed_data();
+  clear_tmp_file();
 }
 
 void Cluster::clear_raw_data() {
@@ -72,26 +199,51 @@ void Cluster::clear_compressed_data() {
   }
 }
 
-void Cluster::close() {
-  if (getCompression() != zim::zimcompDefault
-    && getCompression() != zim::zimcompNone) {
+void Cluster::clear_tmp_file() {
+  if (!tmp_filename.empty()) {
+    DEFAULTFS::removeFile(tmp_filename);
+    tmp_filename.clear();
+  }
+}
 
-    // We must compress the content in a buffer.
-    compress();
+void Cluster::close() {
+  if (isCompressed()) {
+    if (streamed) {
+      // The compressed content is too big to be kept in memory.
+      compressToTmpFile();
+    } else {
+      // We must compress the content in a buffer.
+      compress();
+      compressedSize = zsize_t(compressed_data.size());
+    }
     clear_raw_data();
   }
-  closed = true;
+  {
+    std::lock_guard<std::mutex> l(closedMutex);
+    closed = true;
+  }
+  closedCond.notify_all();
 }
 
 bool Cluster::isClosed() const{
   return closed;
 }
 
+void Cluster::waitClosed() {
+  std::unique_lock<std::mutex> l(closedMutex);
+  closedCond.wait(l, [this]{ return bool(closed); });
+}
+
 zsize_t Cluster::size() const
 {
   if (isClosed()) {
     throw std::runtime_error("oups");
   }
+  return contentSize();
+}
+
+zsize_t Cluster::contentSize() const
+{
   if (isExtended) {
     return zsize_t(blobOffsets.size() * sizeof(uint64_t)) + _size;
   } else {
@@ -141,7 +293,11 @@ void Cluster::compress()
 
     case zim::zimcompZstd:
       {
-        _compress<ZSTD_INFO>();
+        if (isSeekable()) {
+          _compressFrames<ZSTD_INFO>();
+        } else {
+          _compress<ZSTD_INFO>();
+        }
         break;
       }
 
@@ -154,10 +310,12 @@ template<typename COMP_TYPE>
 void Cluster::_compress()
 {
   Compressor<COMP_TYPE> runner;
+  // Only big clusters are worth splitting between several threads.
+  auto nbThreads = std::min<size_type>(compressionThreads, size().v / COMP_TYPE::mt_block_size(compressionLevel));
   bool first = true;
   auto writer = [&](const Blob& data) -> void {
     if (first) {
-      runner.init((char*)data.data());
+      runner.init((char*)data.data(), compressionLevel, std::max<size_type>(nbThreads, 1));
       first = false;
     }
     runner.feed(data.data(), data.size());
@@ -168,6 +326,161 @@ void Cluster::_compress()
   compressed_data = Blob(comp.release(), size.v);
 }
 
+template<typename COMP_TYPE>
+std::vector<zsize_t> Cluster::_compressFrames(frame_writer_t output) const
+{
+  // Compress the content in independent frames of `frameSize` bytes.
+  std::vector<zsize_t> frameSizes;
+  std::unique_ptr<char[]> frame(new char[frameSize]);
+  size_type frameFill = 0;
+
+  auto compressFrame = [&]() {
+    Compressor<COMP_TYPE> runner(frameFill/2 + 1024);
+    runner.init(frame.get(), compressionLevel);
+    runner.feed(frame.get(), frameFill);
+    zsize_t size;
+    auto data = runner.get_data(&size);
+    frameSizes.push_back(size);
+    output(std::move(data), size);
+    frameFill = 0;
+  };
+
+  auto writer = [&](const Blob& data) -> void {
+    const char* src = data.data();
+    size_type to_write = data.size();
+    while (to_write) {
+      auto chunk_size = std::min(to_write, frameSize - frameFill);
+      memcpy(frame.get() + frameFill, src, chunk_size);
+      frameFill += chunk_size;
+      src += chunk_size;
+      to_write -= chunk_size;
+      if (frameFill == frameSize) {
+        compressFrame();
+      }
+    }
+  };
+  write_content(writer);
+  if (frameFill) {
+    compressFrame();
+  }
+  return frameSizes;
+}
+
+template<typename COMP_TYPE>
+void Cluster::_compressFrames()
+{
+  // Put the frame index in front of the frames.
+  std::vector<std::unique_ptr<char[]>> frames;
+  const auto dataSize = size().v;
+  auto frameSizes = _compressFrames<COMP_TYPE>([&](std::unique_ptr<char[]> frame, zsize_t) {
+    frames.push_back(std::move(frame));
+  });
+
+  const size_type indexSize = frameIndexSize(frames.size());
+  size_type totalSize = indexSize;
+  for (auto size: frameSizes) {
+    totalSize += size.v;
+  }
+
+  char* out = new char[totalSize];
+  writeFrameIndex(out, frameSize, frameSizes, dataSize);
+  char* p = out + indexSize;
+  for (size_t i = 0; i < frames.size(); ++i) {
+    memcpy(p, frames[i].get(), frameSizes[i].v);
+    p += frameSizes[i].v;
+  }
+  compressed_data = Blob(out, totalSize);
+}
+
+void Cluster::compressToTmpFile()
+{
+#ifdef _WIN32
+  int mode = _S_IREAD | _S_IWRITE;
+#else
+  mode_t mode = S_IRUSR | S_IWUSR;
+#endif
+  const auto fd = open(tmp_filename.c_str(), O_RDWR|O_CREAT|O_TRUNC, mode);
+  if (fd == -1) {
+    throw std::runtime_error("Cannot create file " + tmp_filename);
+  }
+  try {
+    write_compressed(fd);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+}
+
+void Cluster::write_compressed(int out_fd) const
+{
+  switch(getCompression()) {
+    case zim::zimcompLzma:
+      _compressTo<LZMA_INFO>(out_fd);
+      break;
+
+    case zim::zimcompZstd:
+      if (isSeekable()) {
+        _compressFramesTo<ZSTD_INFO>(out_fd);
+      } else {
+        _compressTo<ZSTD_INFO>(out_fd);
+      }
+      break;
+
+    default:
+      throw std::runtime_error("Compression method not enabled in this library");
+  }
+}
+
+template<typename COMP_TYPE>
+void Cluster::_compressTo(int out_fd) const
+{
+  BufferedWriter out(out_fd);
+  StreamCompressor<COMP_TYPE> runner([&](const char* data, size_t size) {
+    out.write(data, size);
+  });
+  auto nbThreads = std::min<size_type>(compressionThreads, contentSize().v / COMP_TYPE::mt_block_size(compressionLevel));
+  bool first = true;
+  auto writer = [&](const Blob& data) -> void {
+    if (first) {
+      runner.init((char*)data.data(), compressionLevel, std::max<size_type>(nbThreads, 1));
+      first = false;
+    }
+    runner.feed(data.data(), data.size());
+  };
+  write_content(writer);
+  compressedSize = runner.finish();
+  out.flush();
+}
+
+template<typename COMP_TYPE>
+void Cluster::_compressFramesTo(int out_fd) const
+{
+  // The number of frames is known, the space of the frame index is
+  // reserved and the index is written once the frames are compressed.
+  const auto dataSize = contentSize().v;
+  const auto nbFrames = (dataSize + frameSize - 1) / frameSize;
+  std::vector<char> index(frameIndexSize(nbFrames));
+  const auto indexOffset = lseek(out_fd, 0, SEEK_CUR);
+  BufferedWriter out(out_fd);
+  out.write(index.data(), index.size());
+  size_type totalSize = index.size();
+  auto frameSizes = _compressFrames<COMP_TYPE>([&](std::unique_ptr<char[]> frame, zsize_t size) {
+    out.write(frame.get(), size.v);
+    totalSize += size.v;
+  });
+  out.flush();
+  ASSERT(frameSizes.size(), ==, nbFrames);
+
+  writeFrameIndex(index.data(), frameSize, frameSizes, dataSize);
+  const auto endOffset = lseek(out_fd, 0, SEEK_CUR);
+  lseek(out_fd, indexOffset, SEEK_SET);
+  out.write(index.data(), index.size());
+  out.flush();
+  lseek(out_fd, endOffset, SEEK_SET);
+  compressedSize = zsize_t(totalSize);
+}
+
 void Cluster::write(int out_fd) const
 {
   // write clusterInfo
@@ -176,6 +489,9 @@ void Cluster::write(int out_fd) const
     clusterInfo = 0x10;
   }
   clusterInfo += getCompression();
+  if (isSeekable()) {
+    clusterInfo += 0x20;
+  }
   if (_write(out_fd, &clusterInfo, 1) == -1) {
     throw std::runtime_error("Error writng");
   }
@@ -186,21 +502,29 @@ void Cluster::write(int out_fd) const
     case zim::zimcompDefault:
     case zim::zimcompNone:
     {
-      auto writer = [=](const Blob& data) -> void {
-        // Ideally we would simply have to do :
-        // ::write(tmp_fd, data.c_str(), data.size());
-        // However, the data can be pretty big (> 4Gb), especially with test,
-        // And ::write fails to write data > 4Gb. So we have to chunck the write.
-        size_type to_write = data.size();
-        const char* src = data.data();
-        while (to_write) {
-         size_type chunk_size = to_write > 4096 ? 4096 : to_write;
-         auto ret = _write(out_fd, src, chunk_size);
-         src += ret;
-         to_write -= ret;
-        }
+      BufferedWriter out(out_fd);
+      auto writer = [&](const Blob& data) -> void {
+        out.write(data.data(), data.size());
       };
-      write_content(writer);
+      if (isExtended) {
+        write_offsets<uint64_t>(writer);
+      } else {
+        write_offsets<uint32_t>(writer);
+      }
+      for (auto& provider: m_providers) {
+        // The content of big files is copied from file to file by the
+        // system, without reading it in a user space buffer.
+        // (The provider is only fed if the system can't copy the file.)
+        const auto path = providedFilePath(*provider);
+        if (path && provider->getSize() >= ZERO_COPY_MIN_SIZE) {
+          out.flush();
+          if (copyFile(*path, provider->getSize(), out_fd, writer)) {
+            continue;
+          }
+        }
+        write_provider_data(*provider, writer);
+      }
+      out.flush();
       break;
     }
 
@@ -209,6 +533,17 @@ void Cluster::write(int out_fd) const
     case zim::zimcompLzma:
     case zim::zimcompZstd:
       {
+        if (streamed) {
+          BufferedWriter out(out_fd);
+          auto writer = [&](const Blob& data) -> void {
+            out.write(data.data(), data.size());
+          };
+          if (!copyFile(tmp_filename, compressedSize.v, out_fd, writer)) {
+            readFile(DEFAULTFS::openFile(tmp_filename), tmp_filename, 0, compressedSize.v, writer);
+          }
+          out.flush();
+          break;
+        }
         log_debug("compress data");
         if (_write(out_fd, compressed_data.data(), compressed_data.size()) == -1) {
           throw std::runtime_error("Error writing");
@@ -247,18 +582,23 @@ void Cluster::write_data(writer_t writer) const
 {
   for (auto& provider: m_providers)
   {
-    ASSERT(provider->getSize(), !=, 0U);
-    zim::size_type size = 0;
-    while(true) {
-      auto blob = provider->feed();
-      if(blob.size() == 0) {
-        break;
-      }
-      size += blob.size();
-      writer(blob);
+    write_provider_data(*provider, writer);
+  }
+}
+
+void Cluster::write_provider_data(ContentProvider& provider, writer_t writer)
+{
+  ASSERT(provider.getSize(), !=, 0U);
+  zim::size_type size = 0;
+  while(true) {
+    auto blob = provider.feed();
+    if(blob.size() == 0) {
+      break;
     }
-    ASSERT(size, ==, provider->getSize());
+    size += blob.size();
+    writer(blob);
   }
+  ASSERT(size, ==, provider.getSize());
 }
 
 } // writer
@@ -26,6 +26,9 @@
 #include <vector>
 #include <functional>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
 
 #include <zim/writer/item.h>
 #include "../zim_types.h"
@@ -35,6 +38,7 @@ namespace zim {
 namespace writer {
 
 using writer_t = std::function<void(const Blob& data)>;
+using frame_writer_t = std::function<void(std::unique_ptr<char[]> frame, zsize_t size)>;
 class ContentProvider;
 
 class Cluster {
@@ -43,26 +47,42 @@ class Cluster {
 
 
   public:
-    Cluster(CompressionType compression);
+    Cluster(CompressionType compression, size_type frameSize = 0);
     virtual ~Cluster();
 
     void setCompression(CompressionType c) { compression = c; }
     CompressionType getCompression() const { return compression; }
+    bool isCompressed() const { return compression != zimcompDefault && compression != zimcompNone; }
+    bool isSeekable() const { return frameSize && compression == zimcompZstd; }
+    void setCompressionLevel(int level) { compressionLevel = level; }
+    int getCompressionLevel() const { return compressionLevel; }
+    void setCompressionThreads(unsigned nbThreads) { compressionThreads = nbThreads; }
+    // A streamed cluster is compressed in the temporary file `tmpPath`
+    // when closed and copied from it to the archive. Neither the content
+    // nor the compressed data is kept in memory.
+    void setStreamed(const std::string& tmpPath) { streamed = true; tmp_filename = tmpPath; }
+    bool isStreamed() const { return streamed; }
 
     void addContent(std::unique_ptr<ContentProvider> provider);
     void addContent(const std::string& data);
 
     blob_index_t count() const  { return blob_index_t(blobOffsets.size() - 1); }
     zsize_t size() const;
+    // Size of the content (without the offsets), still known once closed.
+    zsize_t getDataSize() const { return _size; }
     offset_t getOffset() const { return offset; }
     void setOffset(offset_t o) { offset = o; }
     bool is_extended() const { return isExtended; }
     void clear_data();
+    zsize_t getCompressedSize() const { return compressedSize; }
     void close();
     bool isClosed() const;
+    void waitClosed();
 
     void setClusterIndex(cluster_index_t idx) { index = idx; }
     cluster_index_t getClusterIndex() const { return index; }
+    // False until the cluster is closed by the creator.
+    bool hasClusterIndex() const { return index.v != std::numeric_limits<cluster_index_type>::max(); }
 
     zsize_t getBlobSize(blob_index_t n) const
     { return zsize_t(blobOffsets[blob_index_type(n)+1].v - blobOffsets[blob_index_type(n)].v); }
@@ -71,8 +91,13 @@ class Cluster {
 
   protected:
     CompressionType compression;
+    size_type frameSize;
+    int compressionLevel;
+    unsigned compressionThreads;
+    mutable zsize_t compressedSize;
     cluster_index_t index;
     bool isExtended;
+    bool streamed;
     Offsets blobOffsets;
     offset_t offset;
     zsize_t _size;
@@ -80,17 +105,33 @@ class Cluster {
     mutable Blob compressed_data;
     std::string tmp_filename;
     std::atomic<bool> closed { false };
+    std::mutex closedMutex;
+    std::condition_variable closedCond;
 
   private:
+    zsize_t contentSize() const;
     void write_content(writer_t writer) const;
     template<typename OFFSET_TYPE>
     void write_offsets(writer_t writer) const;
     void write_data(writer_t writer) const;
+    static void write_provider_data(ContentProvider& provider, writer_t writer);
     void compress();
     template<typename COMP_INFO>
     void _compress();
+    template<typename COMP_INFO>
+    void _compressFrames();
+    template<typename COMP_INFO>
+    std::vector<zsize_t> _compressFrames(frame_writer_t output) const;
+    void compressToTmpFile();
+    // Compress the content of a streamed cluster to `out_fd`.
+    void write_compressed(int out_fd) const;
+    template<typename COMP_INFO>
+    void _compressTo(int out_fd) const;
+    template<typename COMP_INFO>
+    void _compressFramesTo(int out_fd) const;
     void clear_raw_data();
     void clear_compressed_data();
+    void clear_tmp_file();
 };
 
 };
@@ -47,7 +47,6 @@ namespace zim
 
     FileProvider::FileProvider(const std::string& filepath)
       : filepath(filepath),
-        buffer(new char[BUFFER_SIZE]),
         fd(new DEFAULTFS::FD(DEFAULTFS::openFile(filepath))),
         offset(0)
     {
@@ -60,9 +59,16 @@ namespace zim
     {
       auto sizeToRead = std::min(BUFFER_SIZE, size-offset);
       if (!sizeToRead) {
+        buffer.reset();
         return Blob(nullptr, 0);
       }
 
+      // Allocated on first use only, providers may wait a long time in an
+      // open cluster (and some are never fed).
+      if (!buffer) {
+        buffer.reset(new char[std::min(BUFFER_SIZE, size)]);
+      }
+
       if(fd->readAt(buffer.get(), zim::zsize_t(sizeToRead), zim::offset_t(offset)).v == -1UL) {
         throw std::runtime_error("Error reading file " + filepath);
       }
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_WRITER_CONTENTPROVIDERACCESS_H
+#define ZIM_WRITER_CONTENTPROVIDERACCESS_H
+
+#include <zim/writer/contentProvider.h>
+
+#include <string>
+
+namespace zim
+{
+  namespace writer
+  {
+    namespace detail
+    {
+      // A derived class may name the protected members of its base: the
+      // pointers to these members give access to the content of the
+      // providers of libzim without feeding them (nor declaring internal
+      // classes as friends in the public header).
+      struct StringProviderAccess : StringProvider {
+        static const std::string& get(const StringProvider& p)
+        { return p.*(&StringProviderAccess::content); }
+      };
+
+      struct SharedStringProviderAccess : SharedStringProvider {
+        static const std::string& get(const SharedStringProvider& p)
+        { return *(p.*(&SharedStringProviderAccess::content)); }
+      };
+
+      struct FileProviderAccess : FileProvider {
+        static const std::string& get(const FileProvider& p)
+        { return p.*(&FileProviderAccess::filepath); }
+      };
+    }
+
+    // The content of a provider already in memory (`StringProvider` or
+    // `SharedStringProvider`), or nullptr.
+    inline const std::string* inMemoryContent(const ContentProvider& provider)
+    {
+      if (auto p = dynamic_cast<const StringProvider*>(&provider)) {
+        return &detail::StringProviderAccess::get(*p);
+      }
+      if (auto p = dynamic_cast<const SharedStringProvider*>(&provider)) {
+        return &detail::SharedStringProviderAccess::get(*p);
+      }
+      return nullptr;
+    }
+
+    // The path of the file of a `FileProvider`, or nullptr.
+    inline const std::string* providedFilePath(const ContentProvider& provider)
+    {
+      if (auto p = dynamic_cast<const FileProvider*>(&provider)) {
+        return &detail::FileProviderAccess::get(*p);
+      }
+      return nullptr;
+    }
+  }
+}
+
+#endif // ZIM_WRITER_CONTENTPROVIDERACCESS_H
@@ -27,10 +27,17 @@
 #include "workers.h"
 #include <zim/blob.h>
 #include <zim/writer/contentProvider.h>
+#include "contentProviderAccess.h"
 #include "../endian_tools.h"
 #include <algorithm>
+#include <condition_variable>
+#include <exception>
 #include <fstream>
-#include "../md5.h"
+#include <future>
+#include "../checksum.h"
+#include "../compression.h"
+#include "../fileimpl.h"
+#include "parallelSort.h"
 
 #if defined(ENABLE_XAPIAN)
   #include "xapianIndexer.h"
@@ -40,6 +47,7 @@
 # include <io.h>
 #else
 # include <unistd.h>
+# include <sys/resource.h>
 # define _write(fd, addr, size) if(::write((fd), (addr), (size)) != (ssize_t)(size)) \
 {throw std::runtime_error("Error writing");}
 #endif
@@ -47,6 +55,8 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <cmath>
+#include <cstring>
 #include <limits>
 #include <stdexcept>
 #include <sstream>
@@ -74,7 +84,7 @@ log_define("zim.writer.creator")
     if (m_verbose ) { \
         double seconds = difftime(time(NULL),data->start_time);  \
         std::cout << "T:" << (int)seconds \
-                  << "; A:" << data->dirents.size() \
+                  << "; A:" << data->nbDirents \
                   << "; RA:" << data->nbRedirectItems \
                   << "; CA:" << data->nbCompItems \
                   << "; UA:" << data->nbUnCompItems \
@@ -93,6 +103,327 @@ namespace zim
 {
   namespace writer
   {
+    namespace
+    {
+      // Number of items serialized together before being written.
+      const size_t DIRENTS_CHUNK_SIZE = 16*1024;
+      const size_t POINTERS_CHUNK_SIZE = 128*1024;
+
+      // Write `count` items by chunks of `chunkSize` items.
+      // `serialize(begin, end, buffer)` must fill `buffer` with the items
+      // [begin, end). Up to `nbThreads` chunks are serialized at the same
+      // time, and the chunks are written in order, one write per chunk.
+      template<typename Serializer>
+      void writeByChunks(int out_fd, size_t count, size_t chunkSize,
+                         unsigned nbThreads, Serializer serialize)
+      {
+        nbThreads = std::max(nbThreads, 1U);
+        const auto policy = nbThreads > 1 ? std::launch::async : std::launch::deferred;
+        for (size_t start=0; start<count; start+=chunkSize*nbThreads) {
+          std::vector<std::future<std::vector<char>>> chunks;
+          for (unsigned i=0; i<nbThreads && start+i*chunkSize<count; i++) {
+            const auto begin = start + i*chunkSize;
+            const auto end = std::min(begin+chunkSize, count);
+            chunks.push_back(std::async(policy, [=]() {
+              std::vector<char> buffer;
+              serialize(begin, end, buffer);
+              return buffer;
+            }));
+          }
+          for (auto& chunk: chunks) {
+            const auto buffer = chunk.get();
+            _write(out_fd, buffer.data(), buffer.size());
+          }
+        }
+      }
+
+      // Number of CreatorData created, to identify them (see getProducer).
+      std::atomic<uint64_t> creatorDataCount(0);
+
+      // Number of titles sent together to the title indexing thread.
+      const size_t TITLE_BATCH_SIZE = 1024;
+
+      // Bigger items are not deduplicated, unless they are files (their
+      // content is read in memory).
+      const size_type DEDUP_MAX_ITEM_SIZE = 16*1024*1024;
+
+      // Size of the blocks of the files read to compute their hash.
+      const size_type DEDUP_FILE_BLOCK_SIZE = 1024*1024;
+
+      // Bigger indexed items are read twice (for the cluster and for the
+      // indexer) instead of being kept in memory until they are indexed.
+      const size_type SHARED_CONTENT_MAX_SIZE = 16*1024*1024;
+
+      std::shared_ptr<const std::string> readContent(ContentProvider& provider)
+      {
+        auto content = std::make_shared<std::string>();
+        content->reserve(provider.getSize());
+        while (true) {
+          auto blob = provider.feed();
+          if (blob.size() == 0) {
+            break;
+          }
+          content->append(blob.data(), blob.size());
+        }
+        ASSERT(content->size(), ==, provider.getSize());
+        return content;
+      }
+
+      // Bigger contents are not read in memory by ItemFetcher.
+      const size_type PREFETCH_MAX_SIZE = 16*1024*1024;
+
+      // Fetch the content of a batch of items (see Creator::addItems) with
+      // several threads. The threads fetch the items in order, at most
+      // `window` items after the last one taken with `get`.
+      class ItemFetcher
+      {
+        public:
+          struct Fetched {
+            std::unique_ptr<ContentProvider> provider;
+            // The content, if read in memory.
+            std::shared_ptr<const std::string> content;
+          };
+
+          ItemFetcher(const std::vector<std::shared_ptr<Item>>& items, unsigned nbThreads)
+            : items(items),
+              fetched(items.size()),
+              errors(items.size()),
+              done(items.size(), false),
+              window(2 * nbThreads)
+          {
+            for (unsigned i=0; i<nbThreads; i++) {
+              threads.emplace_back(&ItemFetcher::run, this);
+            }
+          }
+
+          ~ItemFetcher()
+          {
+            {
+              std::lock_guard<std::mutex> l(mutex);
+              stopped = true;
+            }
+            cond.notify_all();
+            for (auto& thread: threads) {
+              thread.join();
+            }
+          }
+
+          // Wait for the item `i` to be fetched. Items must be taken in order.
+          Fetched get(size_t i)
+          {
+            std::unique_lock<std::mutex> l(mutex);
+            cond.wait(l, [&]{ return bool(done[i]); });
+            taken = i + 1;
+            cond.notify_all();
+            if (errors[i]) {
+              std::rethrow_exception(errors[i]);
+            }
+            return std::move(fetched[i]);
+          }
+
+        private:
+          static Fetched fetch(const Item& item)
+          {
+            Fetched f;
+            f.provider = item.getContentProvider();
+            bool ready;
+            if (auto prefetchable = dynamic_cast<PrefetchableProvider*>(f.provider.get())) {
+              prefetchable->prefetch();
+              ready = prefetchable->ready();
+            } else {
+              // The file providers are not read in memory either, the
+              // cluster copies the file directly.
+              ready = inMemoryContent(*f.provider) || providedFilePath(*f.provider);
+            }
+            if (!ready && f.provider->getSize() <= PREFETCH_MAX_SIZE) {
+              f.content = readContent(*f.provider);
+              f.provider.reset(new SharedStringProvider(f.content));
+            }
+            return f;
+          }
+
+          void run()
+          {
+            while (true) {
+              size_t i;
+              {
+                std::unique_lock<std::mutex> l(mutex);
+                cond.wait(l, [&]{ return stopped || next == items.size() || next < taken + window; });
+                if (stopped || next == items.size()) {
+                  return;
+                }
+                i = next++;
+              }
+              Fetched f;
+              std::exception_ptr error;
+              try {
+                f = fetch(*items[i]);
+              } catch (...) {
+                error = std::current_exception();
+              }
+              {
+                std::lock_guard<std::mutex> l(mutex);
+                fetched[i] = std::move(f);
+                errors[i] = error;
+                done[i] = true;
+              }
+              cond.notify_all();
+            }
+          }
+
+          const std::vector<std::shared_ptr<Item>>& items;
+          std::vector<Fetched> fetched;
+          std::vector<std::exception_ptr> errors;
+          std::vector<bool> done;
+          const size_t window;
+          size_t next = 0;
+          size_t taken = 0;
+          bool stopped = false;
+          std::mutex mutex;
+          std::condition_variable cond;
+          std::vector<std::thread> threads;
+      };
+
+      // Only the beginning of the items is sampled to detect if they are
+      // compressible. Smaller items are not sampled, their entropy cannot
+      // be estimated reliably.
+      const size_type COMPRESSION_SAMPLE_SIZE = 16*1024;
+      const size_type COMPRESSION_SAMPLE_MIN_SIZE = 1024;
+      // Content with a higher entropy (in bits per byte) is considered
+      // already compressed.
+      const double MAX_COMPRESSIBLE_ENTROPY = 7.5;
+
+      // Order-0 entropy of the bytes of `data`, in bits per byte.
+      double byteEntropy(const char* data, size_t size)
+      {
+        if (size == 0) {
+          return 0;
+        }
+        size_t counts[256] = {};
+        for (size_t i=0; i<size; i++) {
+          counts[static_cast<unsigned char>(data[i])]++;
+        }
+        double sum = 0;
+        for (auto count: counts) {
+          if (count) {
+            sum += count * std::log2(double(count));
+          }
+        }
+        return std::log2(double(size)) - sum / size;
+      }
+
+      // Provide the content of `provider` whose beginning (`head`) has
+      // already been read.
+      class SampledProvider : public ContentProvider
+      {
+        public:
+          SampledProvider(std::string head, std::unique_ptr<ContentProvider> provider)
+            : head(std::move(head)),
+              provider(std::move(provider)),
+              headFeeded(false)
+          {}
+
+          size_type getSize() const { return provider->getSize(); }
+          Blob feed()
+          {
+            if (!headFeeded) {
+              headFeeded = true;
+              return Blob(head.data(), head.size());
+            }
+            return provider->feed();
+          }
+
+        private:
+          std::string head;
+          std::unique_ptr<ContentProvider> provider;
+          bool headFeeded;
+      };
+
+#if defined(ENABLE_XAPIAN)
+      // Providers which already have the content in memory.
+      bool isInMemory(const ContentProvider* provider)
+      {
+        return inMemoryContent(*provider) != nullptr;
+      }
+#endif
+
+      // Size of the buffer used to copy the clusters of an updated archive
+      // when the system cannot copy them itself.
+      const size_type COPY_BUFFER_SIZE = 1024*1024;
+
+      // Provide the content of a blob of an existing archive.
+      class BlobProvider : public ContentProvider
+      {
+        public:
+          explicit BlobProvider(const Blob& blob)
+            : blob(blob),
+              feeded(false)
+          {}
+
+          size_type getSize() const { return blob.size(); }
+          Blob feed()
+          {
+            if (feeded) {
+              return Blob(nullptr, 0);
+            }
+            feeded = true;
+            return blob;
+          }
+
+        private:
+          Blob blob;
+          bool feeded;
+      };
+
+      // An item of an updated archive, read back to be fulltext indexed.
+      class ReusedItem : public BasicItem
+      {
+        public:
+          ReusedItem(std::shared_ptr<FileImpl> archive, const std::string& path,
+                     const std::string& mimetype, const std::string& title,
+                     cluster_index_t clusterNumber, blob_index_t blobNumber)
+            : BasicItem(path, mimetype, title),
+              archive(archive),
+              clusterNumber(clusterNumber),
+              blobNumber(blobNumber)
+          {}
+
+          std::unique_ptr<ContentProvider> getContentProvider() const
+          {
+            auto blob = archive->getCluster(clusterNumber)->getBlob(blobNumber);
+            return std::unique_ptr<ContentProvider>(new BlobProvider(blob));
+          }
+
+        private:
+          std::shared_ptr<FileImpl> archive;
+          cluster_index_t clusterNumber;
+          blob_index_t blobNumber;
+      };
+
+      // The key of a content in CreatorData::dedupContents: the first 8 bytes
+      // of its SHA-256 digest.
+      uint64_t dedupKey(const unsigned char sha256[Sha256::DIGEST_SIZE])
+      {
+        uint64_t key;
+        std::memcpy(&key, sha256, sizeof(key));
+        return key;
+      }
+
+      template<typename Container, typename Getter>
+      void writeIntegers(int out_fd, const Container& items, unsigned nbThreads, Getter getter)
+      {
+        typedef decltype(getter(items[0])) T;
+        writeByChunks(out_fd, items.size(), POINTERS_CHUNK_SIZE, nbThreads,
+          [&](size_t begin, size_t end, std::vector<char>& buffer) {
+            buffer.resize((end-begin)*sizeof(T));
+            auto p = buffer.data();
+            for (auto i=begin; i<end; i++, p+=sizeof(T)) {
+              toLittleEndian(getter(items[i]), p);
+            }
+          });
+      }
+    }
+
     Creator::Creator() = default;
     Creator::~Creator() = default;
 
@@ -108,12 +439,79 @@ namespace zim
       return *this;
     }
 
+    Creator& Creator::configCompressionLevel(int level)
+    {
+      m_compressionLevel = level;
+      return *this;
+    }
+
+    Creator& Creator::configAdaptiveCompressionLevel(double targetMBps)
+    {
+      if (targetMBps < 0) {
+        throw std::runtime_error("Compression throughput target cannot be negative");
+      }
+      m_adaptiveCompressionTarget = targetMBps;
+      return *this;
+    }
+
+    Creator& Creator::configStreamedItemSize(zim::size_type size)
+    {
+      m_streamedItemSize = size;
+      return *this;
+    }
+
+    Creator& Creator::configCompressionDetection(bool detect)
+    {
+      m_compressionDetection = detect;
+      return *this;
+    }
+
     Creator& Creator::configMinClusterSize(zim::size_type size)
     {
       m_minClusterSize = size;
       return *this;
     }
 
+    Creator& Creator::configClusterFrameSize(zim::size_type frameSize)
+    {
+      // Frame sizes are stored on 32 bits (even once compressed).
+      if (frameSize >= (1ULL << 31)) {
+        throw std::runtime_error("Cluster frame size must be lower than 2GiB");
+      }
+      m_clusterFrameSize = frameSize;
+      return *this;
+    }
+
+    Creator& Creator::configExternalDirentSort(zim::size_type memoryBudget)
+    {
+      m_externalSortMemory = memoryBudget;
+      return *this;
+    }
+
+    Creator& Creator::configClusteringWindow(zim::size_type windowSize)
+    {
+      m_clusteringWindow = windowSize;
+      return *this;
+    }
+
+    Creator& Creator::configDeduplication(bool dedup)
+    {
+      m_deduplication = dedup;
+      return *this;
+    }
+
+    Creator& Creator::configClusterMemoryBudget(zim::size_type budget)
+    {
+      m_clusterMemoryBudget = budget;
+      return *this;
+    }
+
+    Creator& Creator::configClusterReorderWindow(size_t window)
+    {
+      m_clusterReorderWindow = window;
+      return *this;
+    }
+
     Creator& Creator::configIndexing(bool indexing, std::string language)
     {
       m_withIndex = indexing;
@@ -127,12 +525,29 @@ namespace zim
       return *this;
     }
 
+    Creator& Creator::configFetchConcurrency(unsigned nbFetchers)
+    {
+      m_nbFetchers = nbFetchers;
+      return *this;
+    }
+
     void Creator::startZimCreation(const std::string& filepath)
     {
       data = std::unique_ptr<CreatorData>(
-        new CreatorData(filepath, m_verbose, m_withIndex, m_indexingLanguage, m_compression)
+        new CreatorData(filepath, m_verbose, m_withIndex, m_indexingLanguage, m_compression, m_clusterFrameSize, m_nbWorkers)
       );
       data->setMinChunkSize(m_minClusterSize);
+      data->setCompressionLevel(m_compressionLevel, m_adaptiveCompressionTarget, m_nbWorkers);
+      data->compressionThreads = m_nbWorkers;
+      if (m_externalSortMemory) {
+        data->useExternalDirents(m_externalSortMemory, m_nbWorkers);
+      }
+      data->clusteringWindow = m_clusteringWindow;
+      data->deduplication = m_deduplication;
+      data->streamedItemSize = m_streamedItemSize;
+      data->compressionDetection = m_compressionDetection;
+      data->clusterMemory.setLimit(m_clusterMemoryBudget);
+      data->clusterReorderWindow = m_clusterReorderWindow;
 
       for(unsigned i=0; i<m_nbWorkers; i++)
       {
@@ -141,36 +556,51 @@ namespace zim
       }
 
       data->writerThread = std::thread(clusterWriter, this->data.get());
+#if defined(ENABLE_XAPIAN)
+      data->titleIndexerThread = std::thread(titleIndexerRunner, this->data.get());
+#endif
     }
 
-    void Creator::addItem(std::shared_ptr<Item> item)
+    void Creator::startZimUpdate(const std::string& filepath, const std::string& existingPath)
     {
-      auto hints = item->getHints();
-
-      bool compressContent;
-      try {
-        compressContent = bool(hints.at(COMPRESS));
-      } catch(std::out_of_range&) {
-        compressContent = isCompressibleMimetype(item->getMimeType());
+      if (m_externalSortMemory) {
+        throw std::runtime_error("Cannot update an archive with the external sort of the dirents");
       }
-
-      auto dirent = data->createItemDirent(item.get());
-      data->addItemData(dirent, item->getContentProvider(), compressContent);
-
-#if defined(ENABLE_XAPIAN)
-      if (item->getMimeType() == "text/html" && !item->getTitle().empty()) {
-        data->nbIndexItems++;
-        data->titleIndexer.indexTitle(item->getPath(), item->getTitle());
-        if(m_withIndex) {
-          data->taskList.pushToQueue(new IndexTask(item));
-        }
+      auto archive = std::make_shared<FileImpl>(existingPath);
+      if (archive->is_multiPart()) {
+        throw std::runtime_error("Cannot update a split archive");
       }
-#endif
+      if (!archive->hasNewNamespaceScheme()) {
+        throw std::runtime_error("Cannot update an archive using the old namespace scheme");
+      }
+      startZimCreation(filepath);
+      data->updatedArchive = archive;
+    }
 
-      if (data->dirents.size()%1000 == 0) {
+    void Creator::addItem(std::shared_ptr<Item> item)
+    {
+      data->addItem(item, item->getContentProvider(), nullptr);
+      if (data->nbDirents%1000 == 0) {
         TPROGRESS();
       }
+    }
 
+    void Creator::addItems(const std::vector<std::shared_ptr<Item>>& items)
+    {
+      if (!m_nbFetchers) {
+        for (auto& item: items) {
+          addItem(item);
+        }
+        return;
+      }
+      ItemFetcher fetcher(items, m_nbFetchers);
+      for (size_t i=0; i<items.size(); i++) {
+        auto fetched = fetcher.get(i);
+        data->addItem(items[i], std::move(fetched.provider), fetched.content);
+        if (data->nbDirents%1000 == 0) {
+          TPROGRESS();
+        }
+      }
     }
 
     void Creator::addMetadata(const std::string& name, const std::string& content, const std::string& mimetype)
@@ -182,67 +612,84 @@ namespace zim
     void Creator::addMetadata(const std::string& name, std::unique_ptr<ContentProvider> provider, const std::string& mimetype)
     {
       auto compressContent = isCompressibleMimetype(mimetype);
-      data->addData('M', name, mimetype, std::move(provider), compressContent);
+      data->addData(data->getProducer(), 'M', name, mimetype, std::move(provider), compressContent);
     }
 
     void Creator::addRedirection(const std::string& path, const std::string& title, const std::string& targetPath)
     {
-      data->createRedirectDirent('C', path, title, 'C', targetPath);
-      if (data->dirents.size()%1000 == 0){
+      auto& producer = data->getProducer();
+      data->createRedirectDirent(producer, 'C', path, title, 'C', targetPath);
+      if (data->nbDirents%1000 == 0){
         TPROGRESS();
       }
 
 #if defined(ENABLE_XAPIAN)
       if (!title.empty()) {
-        data->titleIndexer.indexTitle(path, title);
+        data->indexTitle(producer, path, title);
       }
 #endif
      }
 
+    void Creator::removeEntry(const std::string& path)
+    {
+      if (!data->updatedArchive) {
+        throw std::runtime_error("Only the entries of an updated archive can be removed");
+      }
+      std::lock_guard<std::mutex> l(data->removedPathsMutex);
+      data->removedPaths.push_back(path);
+    }
+
     void Creator::finishZimCreation()
     {
+      auto& producer = data->getProducer();
       // Create mandatory entries
       if (!m_faviconPath.empty()) {
-        data->createRedirectDirent('-', "favicon", "", 'C', m_faviconPath);
+        data->createRedirectDirent(producer, '-', "favicon", "", 'C', m_faviconPath);
       }
 
       // Create a redirection for the mainPage.
       // We need to keep the created dirent to set the fileheader.
       // Dirent doesn't have to be deleted.
       if (!m_mainPath.empty()) {
-        data->mainPageDirent = data->createRedirectDirent('-', "mainPage", "", 'C', m_mainPath);
+        data->mainPageDirent = data->createRedirectDirent(producer, '-', "mainPage", "", 'C', m_mainPath);
+        if (data->externalDirents) {
+          data->externalDirents->setMainPage('-', "mainPage");
+        }
+      }
+
+      if (data->updatedArchive) {
+        TINFO("Add the entries of the updated archive");
+        data->addReusedEntries();
+        TINFO(data->nbReusedEntries << " entries reused from "
+              << data->reusedClusters.size() << " clusters");
       }
 
       TPROGRESS();
 
       // We need to wait that all indexation task has been done before closing the
       // xapian database and add it to zim.
-      unsigned int wait = 0;
-      do {
-        microsleep(wait);
-        wait += 10;
-      } while(IndexTask::waiting_task.load() > 0);
+      IndexTask::waiting_task.waitNoPendingTask();
 
 #if defined(ENABLE_XAPIAN)
       {
+        for (auto& p: data->producers) {
+          data->flushTitles(*p);
+        }
+        data->titlesToIndex.pushToQueue(nullptr);
+        data->titleIndexerThread.join();
         data->titleIndexer.indexingPostlude();
         data->addData(
-          'X', "title/xapian", "application/octet-stream+xapian",
+          producer, 'X', "title/xapian", "application/octet-stream+xapian",
           std::unique_ptr<ContentProvider>(new FileProvider(data->titleIndexer.getIndexPath())),
           false
         );
       }
       if (m_withIndex) {
-        wait = 0;
-        do {
-          microsleep(wait);
-          wait += 10;
-        } while(IndexTask::waiting_task.load() > 0);
+        IndexTask::waiting_task.waitNoPendingTask();
 
         data->indexer->indexingPostlude();
-        microsleep(100);
         data->addData(
-          'X', "fulltext/xapian", "application/octet-stream+xapian",
+          producer, 'X', "fulltext/xapian", "application/octet-stream+xapian",
           std::unique_ptr<ContentProvider>(new FileProvider(data->indexer->getIndexPath())),
           false
         );
@@ -250,19 +697,11 @@ namespace zim
 #endif
 
       // When we've seen all items, write any remaining clusters.
-      if (data->compCluster->count())
-        data->closeCluster(true);
-
-      if (data->uncompCluster->count())
-        data->closeCluster(false);
+      data->closeAllClusters();
 
       TINFO("Waiting for workers");
       // wait all cluster compression has been done
-      wait = 0;
-      do {
-        microsleep(wait);
-        wait += 10;
-      } while(ClusterTask::waiting_task.load() > 0);
+      ClusterTask::waiting_task.waitNoPendingTask();
 
       // Quit all workerThreads
       for (auto i=0U; i< m_nbWorkers; i++) {
@@ -276,6 +715,37 @@ namespace zim
       data->clusterToWrite.pushToQueue(nullptr);
       data->writerThread.join();
 
+      if (!data->reusedClusters.empty()) {
+        TINFO("Copy the clusters of the updated archive");
+        data->copyReusedClusters();
+      }
+
+      if (data->compressedRawSize) {
+        const double rawMB = data->compressedRawSize / (1024.0*1024);
+        const double compSeconds = data->compressionTime / 1000000.0;
+        TINFO("compression: " << rawMB << " MB in " << data->compressedSize / (1024.0*1024)
+              << " MB (ratio " << double(data->compressedRawSize) / std::max<size_type>(data->compressedSize, 1)
+              << "), " << (compSeconds > 0 ? rawMB / compSeconds : 0) << " MB/s per worker");
+      }
+
+      if (data->compressionDetection) {
+        TINFO("compression detection: " << data->nbSampledItems << " items sampled, "
+              << data->nbDetectedCompItems << " compressed and "
+              << data->nbDetectedUnCompItems << " stored against their mimetype, in "
+              << data->samplingTime / 1000000.0 << " s");
+      }
+
+      if (data->deduplication) {
+        TINFO("deduplication: " << data->nbDedupItems << " duplicated items on "
+              << data->nbDedupCheckedItems << " checked ("
+              << 100.0 * data->nbDedupItems / std::max<entry_index_type>(data->nbDedupCheckedItems, 1)
+              << "%), " << data->dedupSavedSize / (1024.0*1024) << " MB saved");
+      }
+
+      TINFO("Sort dirents");
+      data->collectDirents();
+      data->sortDirents(m_nbWorkers);
+
       TINFO("ResolveRedirectIndexes");
       data->resolveRedirectIndexes();
 
@@ -287,7 +757,7 @@ namespace zim
 
       TINFO("create title index");
       data->createTitleIndex();
-      TINFO(data->dirents.size() << " title index created");
+      TINFO(data->itemCount() << " title index created");
       TINFO(data->clustersList.size() << " clusters created");
 
       TINFO("write zimfile :");
@@ -297,9 +767,65 @@ namespace zim
       TINFO("rename tmpfile to final one.");
       DEFAULTFS::rename(data->basename+".zim.tmp", data->basename+".zim");
 
+      TINFO("pending clusters peak: " << data->clusterMemory.peak() / (1024.0*1024) << " MB");
+#ifndef _WIN32
+      struct rusage usage;
+      if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        const double maxRssMB = usage.ru_maxrss / (1024.0*1024); // bytes
+#else
+        const double maxRssMB = usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+        TINFO("peak RSS: " << maxRssMB << " MB");
+      }
+#endif
+
       TINFO("finish");
     }
 
+    Creator::Progress Creator::getProgress() const
+    {
+      Progress progress;
+      if (!data) {
+        return progress;
+      }
+      // Only the callers of getProgress share this lock.
+      std::lock_guard<std::mutex> l(data->progressMutex);
+      const std::chrono::duration<double> elapsedTime = elapsed(data->startClock);
+      progress.elapsedTime = elapsedTime.count();
+
+      progress.itemCount = data->nbCompItems + data->nbUnCompItems;
+      progress.redirectCount = data->nbRedirectItems;
+      progress.indexedItemCount = data->nbIndexItems;
+
+      progress.closedClusterCount = data->nbClusters;
+      progress.compressedClusterCount = data->nbCompressedClusters;
+      progress.writtenClusterCount = data->nbWrittenClusters;
+
+      progress.inputSize = data->inputSize;
+      progress.compressedInputSize = data->compressedRawSize;
+      progress.compressedOutputSize = data->compressedSize;
+      progress.writtenSize = data->writtenSize;
+
+      progress.taskQueueSize = data->taskList.size();
+      progress.clusterQueueSize = data->clusterToWrite.size();
+      progress.pendingClusterMemory = data->clusterMemory.used();
+
+      progress.compressionTime = data->compressionTime / 1000000.0;
+      progress.indexingTime = data->indexingTime / 1000000.0;
+      progress.titleIndexingTime = data->titleIndexingTime / 1000000.0;
+      progress.writingTime = data->writingTime / 1000000.0;
+
+      const auto& last = data->lastProgress;
+      const double interval = progress.elapsedTime - last.elapsedTime;
+      if (interval > 0) {
+        progress.inputMBps = (progress.inputSize - last.inputSize) / (1024.0*1024) / interval;
+        progress.writtenMBps = (progress.writtenSize - last.writtenSize) / (1024.0*1024) / interval;
+      }
+      data->lastProgress = progress;
+      return progress;
+    }
+
     void Creator::fillHeader(Fileheader* header) const
     {
       if (data->isExtended) {
@@ -308,14 +834,11 @@ namespace zim
         header->setMajorVersion(Fileheader::zimClassicMajorVersion);
       }
       header->setMinorVersion(Fileheader::zimMinorVersion);
-      header->setMainPage(
-        data->mainPageDirent
-        ? entry_index_type(data->mainPageDirent->getIdx())
-        : std::numeric_limits<entry_index_type>::max());
+      header->setMainPage(data->getMainPageIndex());
       header->setLayoutPage(std::numeric_limits<entry_index_type>::max());
 
       header->setUuid( m_uuid );
-      header->setArticleCount( data->dirents.size() );
+      header->setArticleCount( data->itemCount().v );
 
       header->setMimeListPos( Fileheader::size );
 
@@ -342,38 +865,53 @@ namespace zim
 
       TINFO(" write directory entries");
       lseek(out_fd, 0, SEEK_END);
-      for (Dirent* dirent: data->dirents)
-      {
-        dirent->setOffset(offset_t(lseek(out_fd, 0, SEEK_CUR)));
-        dirent->write(out_fd);
+      if (data->externalDirents) {
+        data->externalDirents->writeDirents(out_fd);
+      } else {
+        // Dirents are written contiguously, their offsets can be computed
+        // without asking the file.
+        auto offset = offset_type(lseek(out_fd, 0, SEEK_CUR));
+        for (Dirent* dirent: data->dirents)
+        {
+          dirent->setOffset(offset_t(offset));
+          offset += dirent->getDirentSize();
+        }
+        const auto& dirents = data->dirents;
+        writeByChunks(out_fd, dirents.size(), DIRENTS_CHUNK_SIZE, m_nbWorkers,
+          [&](size_t begin, size_t end, std::vector<char>& buffer) {
+            buffer.resize(dirents[end-1]->getOffset().v
+                        + dirents[end-1]->getDirentSize()
+                        - dirents[begin]->getOffset().v);
+            auto p = buffer.data();
+            for (auto i=begin; i<end; i++) {
+              dirents[i]->serialize(p);
+              p += dirents[i]->getDirentSize();
+            }
+          });
       }
 
       TINFO(" write url prt list");
       header.setUrlPtrPos(lseek(out_fd, 0, SEEK_CUR));
-      for (auto& dirent: data->dirents)
-      {
-        char tmp_buff[sizeof(offset_type)];
-        toLittleEndian(dirent->getOffset(), tmp_buff);
-        _write(out_fd, tmp_buff, sizeof(offset_type));
+      if (data->externalDirents) {
+        data->externalDirents->writeUrlPtrList(out_fd);
+      } else {
+        writeIntegers(out_fd, data->dirents, m_nbWorkers,
+          [](const Dirent* dirent) { return dirent->getOffset().v; });
       }
 
       TINFO(" write title index");
       header.setTitleIdxPos(lseek(out_fd, 0, SEEK_CUR));
-      for (Dirent* dirent: data->titleIdx)
-      {
-        char tmp_buff[sizeof(entry_index_type)];
-        toLittleEndian(dirent->getIdx().v, tmp_buff);
-        _write(out_fd, tmp_buff, sizeof(entry_index_type));
+      if (data->externalDirents) {
+        data->externalDirents->writeTitleIndex(out_fd);
+      } else {
+        writeIntegers(out_fd, data->titleIdx, m_nbWorkers,
+          [](const Dirent* dirent) { return dirent->getIdx().v; });
       }
 
       TINFO(" write cluster offset list");
       header.setClusterPtrPos(lseek(out_fd, 0, SEEK_CUR));
-      for (auto cluster : data->clustersList)
-      {
-        char tmp_buff[sizeof(offset_type)];
-        toLittleEndian(cluster->getOffset(), tmp_buff);
-        _write(out_fd, tmp_buff, sizeof(offset_type));
-      }
+      writeIntegers(out_fd, data->clustersList, m_nbWorkers,
+        [](const Cluster* cluster) { return cluster->getOffset().v; });
 
       header.setChecksumPos(lseek(out_fd, 0, SEEK_CUR));
 
@@ -382,23 +920,34 @@ namespace zim
       header.write(out_fd);
 
       TINFO(" write checksum");
-      struct zim_MD5_CTX md5ctx;
-      unsigned char batch_read[1024+1];
-      lseek(out_fd, 0, SEEK_SET);
-      zim_MD5Init(&md5ctx);
-      while (true) {
-         auto r = read(out_fd, batch_read, 1024);
-         if (r == -1) {
-           perror("Cannot read");
-           throw std::runtime_error("oups");
-         }
-         if (r == 0)
-           break;
-         batch_read[r] = 0;
-         zim_MD5Update(&md5ctx, batch_read, r);
-      }
+      const auto checksumPos = header.getChecksumPos();
+#if defined(POSIX_FADV_SEQUENTIAL)
+      posix_fadvise(out_fd, 0, checksumPos, POSIX_FADV_SEQUENTIAL);
+#endif
+      unsigned int lastReportedPercent = 0;
       unsigned char digest[16];
-      zim_MD5Final(digest, &md5ctx);
+      computeMd5(
+        [out_fd](char* dest, offset_type offset, size_t size) {
+          lseek(out_fd, offset, SEEK_SET);
+          while (size) {
+            auto r = read(out_fd, dest, size);
+            if (r <= 0) {
+              perror("Cannot read");
+              throw std::runtime_error("Cannot read the zim file to compute its checksum");
+            }
+            dest += r;
+            size -= r;
+          }
+        },
+        checksumPos, digest,
+        [&](size_type done, size_type total) {
+          const unsigned int percent = done * 100 / total;
+          if (percent >= lastReportedPercent + 10) {
+            lastReportedPercent = percent - percent % 10;
+            TINFO("  checksum " << lastReportedPercent << "%");
+          }
+        });
+      lseek(out_fd, checksumPos, SEEK_SET);
       _write(out_fd, reinterpret_cast<const char*>(digest), 16);
     }
 
@@ -406,14 +955,18 @@ namespace zim
                                    bool verbose,
                                    bool withIndex,
                                    std::string language,
-                                   CompressionType c)
+                                   CompressionType c,
+                                   size_type clusterFrameSize,
+                                   unsigned nbWorkers)
       : mainPageDirent(nullptr),
         compression(c),
+        clusterFrameSize(clusterFrameSize),
         withIndex(withIndex),
         indexingLanguage(language),
 #if defined(ENABLE_XAPIAN)
         titleIndexer(language, IndexingMode::TITLE, true),
 #endif
+        id(++creatorDataCount),
         verbose(verbose),
         nbRedirectItems(0),
         nbCompItems(0),
@@ -422,7 +975,10 @@ namespace zim
         nbClusters(0),
         nbCompClusters(0),
         nbUnCompClusters(0),
-        start_time(time(NULL))
+        start_time(time(NULL)),
+        compressedRawSize(0),
+        compressedSize(0),
+        compressionTime(0)
     {
       basename =  (fname.size() > 4 && fname.compare(fname.size() - 4, 4, ".zim") == 0)
                         ? fname.substr(0, fname.size() - 4)
@@ -446,88 +1002,205 @@ int mode =  _S_IREAD | _S_IWRITE;
         throw std::runtime_error("Impossible to seek in file");
       }
 
-      // We keep both a "compressed cluster" and an "uncompressed cluster"
-      // because we don't know which one will fill up first.  We also need
-      // to track the dirents currently in each, so we can fix up the
-      // cluster index if the other one ends up written first.
-      compCluster = new Cluster(compression);
-      uncompCluster = new Cluster(zimcompNone);
-
 #if defined(ENABLE_XAPIAN)
       titleIndexer.indexingPrelude(basename+"_title.idx");
       if (withIndex) {
           indexer = new XapianIndexer(indexingLanguage, IndexingMode::FULL, true);
-          indexer->indexingPrelude(basename+".idx");
+          indexer->indexingPrelude(basename+".idx", nbWorkers);
+      }
+#else
+      (void)nbWorkers; // The number of index shards
+#endif
+    }
+
+#if defined(ENABLE_XAPIAN)
+    void CreatorData::indexTitle(Producer& producer, const std::string& path, const std::string& title)
+    {
+      auto& pendingTitles = producer.pendingTitles;
+      if (!pendingTitles) {
+        pendingTitles.reset(new TitleBatch);
+        pendingTitles->reserve(TITLE_BATCH_SIZE);
+      }
+      pendingTitles->emplace_back(path, title);
+      if (pendingTitles->size() >= TITLE_BATCH_SIZE) {
+        flushTitles(producer);
+      }
+    }
+
+    void CreatorData::flushTitles(Producer& producer)
+    {
+      if (producer.pendingTitles) {
+        titlesToIndex.pushToQueue(producer.pendingTitles.release());
       }
+    }
 #endif
+
+    // We keep both a "compressed cluster" and an "uncompressed cluster"
+    // because we don't know which one will fill up first.  We also need
+    // to track the dirents currently in each, so we can fix up the
+    // cluster index if the other one ends up written first.
+    CreatorData::Producer::Producer(CompressionType compression, size_type clusterFrameSize)
+      : compCluster(new Cluster(compression, clusterFrameSize)),
+        uncompCluster(new Cluster(zimcompNone))
+    {}
+
+    CreatorData::Producer::~Producer()
+    {
+      delete compCluster;
+      delete uncompCluster;
+      for(auto dirent: pendingCompDirents) {
+        delete dirent;
+      }
+      for(auto dirent: pendingUncompDirents) {
+        delete dirent;
+      }
+    }
+
+    CreatorData::Producer& CreatorData::getProducer()
+    {
+      // The producer of the thread is cached to not lock producersMutex on
+      // each call. `id` (unlike the address of the CreatorData) is never
+      // reused by another CreatorData.
+      thread_local uint64_t cachedId = 0;
+      thread_local Producer* cachedProducer = nullptr;
+      if (cachedId == id) {
+        return *cachedProducer;
+      }
+
+      std::lock_guard<std::mutex> l(producersMutex);
+      auto& producer = threadProducers[std::this_thread::get_id()];
+      if (!producer) {
+        producers.emplace_back(new Producer(compression, clusterFrameSize));
+        producer = producers.back().get();
+      }
+      cachedId = id;
+      cachedProducer = producer;
+      return *producer;
+    }
+
+    void CreatorData::closeAllClusters()
+    {
+      for (auto& producer: producers) {
+        packPendingItems(*producer);
+        if (producer->compCluster->count())
+          closeCluster(*producer, true);
+
+        if (producer->uncompCluster->count())
+          closeCluster(*producer, false);
+      }
+
+      // All the clusters have an index now.
+      for (auto dirent: pendingDedupDirents) {
+        externalDirents->add(*dirent);
+        delete dirent;
+      }
+      pendingDedupDirents.clear();
+    }
+
+    void CreatorData::collectDirents()
+    {
+      for (auto& producer: producers) {
+        dirents.insert(dirents.end(), producer->dirents.begin(), producer->dirents.end());
+        DirentsList().swap(producer->dirents);
+      }
     }
 
     CreatorData::~CreatorData()
     {
-      if (compCluster)
-        delete compCluster;
-      if (uncompCluster)
-        delete uncompCluster;
       for(auto& cluster: clustersList) {
         delete cluster;
       }
+      for(auto dirent: pendingDedupDirents) {
+        delete dirent;
+      }
 #if defined(ENABLE_XAPIAN)
       if (indexer)
         delete indexer;
 #endif
     }
 
-    void CreatorData::addDirent(Dirent* dirent)
+    void CreatorData::addDirent(Producer& producer, Dirent* dirent)
     {
-      auto ret = dirents.insert(dirent);
-      if (!ret.second) {
-        Dirent* existing = *ret.first;
-        if (existing->isRedirect() && !dirent->isRedirect()) {
-          unresolvedRedirectDirents.erase(existing);
-          dirents.erase(ret.first);
-          dirents.insert(dirent);
-        } else {
-          std::cerr << "Impossible to add " << dirent->getNamespace() << "/" << dirent->getPath() << std::endl;
-          std::cerr << "  dirent's title to add is : " << dirent->getTitle() << std::endl;
-          std::cerr << "  existing dirent's title is : " << existing->getTitle() << std::endl;
-          return;
+      nbDirents++;
+      if (externalDirents) {
+        // Item dirents are stored once the index of their cluster is known
+        // (see closeCluster).
+        if (dirent->isRedirect()) {
+          {
+            std::lock_guard<std::mutex> l(externalDirentsMutex);
+            externalDirents->add(*dirent);
+          }
+          delete dirent;
+          nbRedirectItems++;
         }
-      };
+        return;
+      }
+
+      // Duplicated urls are handled once dirents are sorted
+      // (see removeDuplicates).
+      producer.dirents.push_back(dirent);
 
-      // If this is a redirect, we're done: there's no blob to add.
       if (dirent->isRedirect())
       {
-        unresolvedRedirectDirents.insert(dirent);
         nbRedirectItems++;
-        return;
       }
     }
 
-    void CreatorData::addItemData(Dirent* dirent, std::unique_ptr<ContentProvider> provider, bool compressContent)
+    void CreatorData::addItem(std::shared_ptr<Item> item, std::unique_ptr<ContentProvider> provider,
+                              std::shared_ptr<const std::string> content)
     {
-      // Add blob data to compressed or uncompressed cluster.
-      auto itemSize = provider->getSize();
-      if (itemSize > 0)
-      {
-        isEmpty = false;
+      auto hints = item->getHints();
+
+      bool compressContent;
+      bool detect = false;
+      try {
+        compressContent = bool(hints.at(COMPRESS));
+      } catch(std::out_of_range&) {
+        compressContent = isCompressibleMimetype(item->getMimeType());
+        detect = compressionDetection;
       }
 
-      auto cluster = compressContent ? compCluster : uncompCluster;
+      auto& producer = getProducer();
+      auto dirent = createItemDirent(producer, item.get());
 
-      // If cluster will be too large, write it to dis, and open a new
-      // one for the content.
-      if ( cluster->count()
-        && cluster->size().v+itemSize >= minChunkSize * 1024
-         )
-      {
-        log_info("cluster with " << cluster->count() << " items, " <<
-                 cluster->size() << " bytes; current title \"" <<
-                 dirent->getTitle() << '\"');
-        cluster = closeCluster(compressContent);
+#if defined(ENABLE_XAPIAN)
+      const bool toIndex = item->getMimeType() == "text/html" && !item->getTitle().empty();
+      // The content of indexed items is read once and shared between the
+      // cluster and the indexer.
+      if (toIndex && withIndex && !content
+       && !isInMemory(provider.get())
+       && provider->getSize() <= SHARED_CONTENT_MAX_SIZE) {
+        content = readContent(*provider);
+        provider.reset(new SharedStringProvider(content));
       }
+#else
+      (void)content; // Only shared with the indexer
+#endif
 
-      dirent->setCluster(cluster);
-      cluster->addContent(std::move(provider));
+      if (detect) {
+        compressContent = detectCompression(provider, compressContent);
+      }
+
+      addItemData(producer, dirent, std::move(provider), compressContent);
+
+#if defined(ENABLE_XAPIAN)
+      if (toIndex) {
+        nbIndexItems++;
+        indexTitle(producer, item->getPath(), item->getTitle());
+        if(withIndex) {
+          taskList.pushToQueue(new IndexTask(item, content));
+        }
+      }
+#endif
+    }
+
+    void CreatorData::addItemData(Producer& producer, Dirent* dirent, std::unique_ptr<ContentProvider> provider, bool compressContent)
+    {
+      if (provider->getSize() > 0)
+      {
+        isEmpty = false;
+      }
+      inputSize += provider->getSize();
 
       if (compressContent) {
         nbCompItems++;
@@ -535,25 +1208,237 @@ int mode =  _S_IREAD | _S_IWRITE;
         nbUnCompItems++;
       }
 
+      if (compressContent && clusteringWindow) {
+        producer.pendingItems.push_back(PendingItem{dirent, std::move(provider)});
+        if (producer.pendingItems.size() >= clusteringWindow) {
+          packPendingItems(producer);
+        }
+        return;
+      }
+
+      packItemData(producer, dirent, std::move(provider), compressContent);
+    }
+
+    void CreatorData::packPendingItems(Producer& producer)
+    {
+      auto& pendingItems = producer.pendingItems;
+      // Group the items by mimetype and by path. Sorting by path puts
+      // the items of the same "directory" next to each other.
+      std::stable_sort(pendingItems.begin(), pendingItems.end(),
+        [](const PendingItem& i1, const PendingItem& i2) {
+          const auto& d1 = *i1.dirent;
+          const auto& d2 = *i2.dirent;
+          if (d1.getMimeType() != d2.getMimeType()) {
+            return d1.getMimeType() < d2.getMimeType();
+          }
+          return compareUrl(&d1, &d2);
+        });
+      for (auto& item: pendingItems) {
+        packItemData(producer, item.dirent, std::move(item.provider), true);
+      }
+      pendingItems.clear();
+    }
+
+    bool CreatorData::detectCompression(std::unique_ptr<ContentProvider>& provider, bool mimetypeDecision)
+    {
+      const auto size = provider->getSize();
+      if (size < COMPRESSION_SAMPLE_MIN_SIZE) {
+        return mimetypeDecision;
+      }
+      BusyTimer timer(samplingTime);
+      const auto sampleSize = std::min(size, COMPRESSION_SAMPLE_SIZE);
+      double entropy;
+      // Sample the content without feeding the providers we know, to keep
+      // their optimizations (no copy of in memory content, file copied
+      // directly by the cluster).
+      if (auto content = inMemoryContent(*provider)) {
+        entropy = byteEntropy(content->data(), sampleSize);
+      } else if (auto path = providedFilePath(*provider)) {
+        const auto fd = DEFAULTFS::openFile(*path);
+        std::unique_ptr<char[]> sample(new char[sampleSize]);
+        if (fd.readAt(sample.get(), zsize_t(sampleSize), offset_t(0)).v == -1UL) {
+          throw std::runtime_error("Error reading file " + *path);
+        }
+        entropy = byteEntropy(sample.get(), sampleSize);
+      } else {
+        std::string head;
+        bool fullyRead = false;
+        while (head.size() < sampleSize) {
+          auto blob = provider->feed();
+          if (blob.size() == 0) {
+            fullyRead = true;
+            break;
+          }
+          head.append(blob.data(), blob.size());
+        }
+        entropy = byteEntropy(head.data(), std::min<size_t>(head.size(), sampleSize));
+        if (fullyRead) {
+          provider.reset(new SharedStringProvider(std::make_shared<const std::string>(std::move(head))));
+        } else {
+          provider.reset(new SampledProvider(std::move(head), std::move(provider)));
+        }
+      }
+
+      nbSampledItems++;
+      const bool compress = entropy <= MAX_COMPRESSIBLE_ENTROPY;
+      if (compress && !mimetypeDecision) {
+        nbDetectedCompItems++;
+      } else if (!compress && mimetypeDecision) {
+        nbDetectedUnCompItems++;
+      }
+      return compress;
     }
 
-    void CreatorData::addData(char ns, const std::string& path, const std::string& mimetype, std::unique_ptr<ContentProvider> provider, bool compressContent) {
-      auto dirent = createDirent(ns, path, mimetype, "");
-      addItemData(dirent, std::move(provider), compressContent);
+    bool CreatorData::deduplicate(Producer& producer, Dirent* dirent, std::unique_ptr<ContentProvider>& provider,
+                                  DedupContent& dedupContent)
+    {
+      auto itemSize = provider->getSize();
+      if (itemSize == 0) {
+        return false;
+      }
+
+      // Contents are identified by their SHA-256. Hash the providers we know
+      // without feeding them, to keep their optimizations (no copy of in
+      // memory content, file copied directly by the cluster).
+      Sha256 sha256;
+      if (auto content = inMemoryContent(*provider)) {
+        sha256.update(content->data(), content->size());
+      } else if (auto path = providedFilePath(*provider)) {
+        // Read by blocks, whatever the size of the file.
+        const auto fd = DEFAULTFS::openFile(*path);
+        std::unique_ptr<char[]> block(new char[std::min(itemSize, DEDUP_FILE_BLOCK_SIZE)]);
+        for (size_type offset = 0; offset < itemSize; offset += DEDUP_FILE_BLOCK_SIZE) {
+          const auto size = std::min(itemSize - offset, DEDUP_FILE_BLOCK_SIZE);
+          if (fd.readAt(block.get(), zsize_t(size), offset_t(offset)).v == -1UL) {
+            throw std::runtime_error("Error reading file " + *path);
+          }
+          sha256.update(block.get(), size);
+        }
+      } else {
+        if (itemSize > DEDUP_MAX_ITEM_SIZE) {
+          return false;
+        }
+        // Read the whole content. It is added to the cluster from memory if
+        // it is not a duplicate.
+        auto content = readContent(*provider);
+        provider.reset(new SharedStringProvider(content));
+        sha256.update(content->data(), content->size());
+      }
+      dedupContent.size = itemSize;
+      sha256.final(dedupContent.sha256);
+
+      std::lock_guard<std::mutex> l(dedupMutex);
+      nbDedupCheckedItems++;
+      auto range = dedupContents.equal_range(dedupKey(dedupContent.sha256));
+      for (auto it = range.first; it != range.second; ++it) {
+        const auto& known = it->second;
+        if (known.size == itemSize
+         && std::memcmp(known.sha256, dedupContent.sha256, sizeof(dedupContent.sha256)) == 0) {
+          dirent->setCluster(known.cluster, known.blobNumber);
+          nbDedupItems++;
+          dedupSavedSize += itemSize;
+          if (externalDirents) {
+            // The dirent is stored once the index of the cluster is known.
+            if (known.cluster == producer.compCluster) {
+              producer.pendingCompDirents.push_back(dirent);
+            } else if (known.cluster == producer.uncompCluster) {
+              producer.pendingUncompDirents.push_back(dirent);
+            } else {
+              std::lock_guard<std::mutex> l(clustersMutex);
+              if (known.cluster->hasClusterIndex()) {
+                std::lock_guard<std::mutex> l(externalDirentsMutex);
+                externalDirents->add(*dirent);
+                delete dirent;
+              } else {
+                // Still open in another producer.
+                pendingDedupDirents.push_back(dirent);
+              }
+            }
+          }
+          return true;
+        }
+      }
+      return false;
     }
 
-    Dirent* CreatorData::createDirent(char ns, const std::string& path, const std::string& mimetype, const std::string& title)
+    void CreatorData::packItemData(Producer& producer, Dirent* dirent, std::unique_ptr<ContentProvider> provider, bool compressContent)
     {
-      auto dirent = pool.getDirent();
+      DedupContent dedupContent;
+      if (deduplication && deduplicate(producer, dirent, provider, dedupContent)) {
+        return;
+      }
+
+      // Add blob data to compressed or uncompressed cluster.
+      auto itemSize = provider->getSize();
+      const bool streamed = streamedItemSize && itemSize >= streamedItemSize;
+      Cluster* cluster;
+      if (streamed) {
+        // The item has its own cluster, compressed by a worker in a
+        // temporary file.
+        cluster = compressContent ? new Cluster(compression, clusterFrameSize) : new Cluster(zimcompNone);
+        cluster->setStreamed(basename + ".zim.stream" + std::to_string(nbStreamedClusters++) + ".tmp");
+      } else {
+        cluster = compressContent ? producer.compCluster : producer.uncompCluster;
+
+        // If cluster will be too large, write it to dis, and open a new
+        // one for the content.
+        if ( cluster->count()
+          && cluster->size().v+itemSize >= minChunkSize * 1024
+           )
+        {
+          log_info("cluster with " << cluster->count() << " items, " <<
+                   cluster->size() << " bytes; current title \"" <<
+                   dirent->getTitle() << '\"');
+          cluster = closeCluster(producer, compressContent);
+        }
+      }
+
+      dirent->setCluster(cluster);
+      if (dedupContent.size) {
+        // The content has been checked, next items may reuse it.
+        dedupContent.cluster = cluster;
+        dedupContent.blobNumber = dirent->getBlobNumber();
+        std::lock_guard<std::mutex> l(dedupMutex);
+        dedupContents.emplace(dedupKey(dedupContent.sha256), dedupContent);
+      }
+      cluster->addContent(std::move(provider));
+      if (streamed) {
+        std::vector<Dirent*> pendingDirents;
+        if (externalDirents) {
+          pendingDirents.push_back(dirent);
+        }
+        queueCluster(cluster, compressContent, pendingDirents);
+      } else if (externalDirents) {
+        (compressContent ? producer.pendingCompDirents : producer.pendingUncompDirents).push_back(dirent);
+      }
+    }
+
+    void CreatorData::addData(Producer& producer, char ns, const std::string& path, const std::string& mimetype, std::unique_ptr<ContentProvider> provider, bool compressContent) {
+      auto dirent = createDirent(producer, ns, path, mimetype, "");
+      addItemData(producer, dirent, std::move(provider), compressContent);
+    }
+
+    Dirent* CreatorData::newDirent(Producer& producer, const std::string& path, const std::string& title, const std::string& redirectPath)
+    {
+      if (externalDirents) {
+        // External dirents are released once stored.
+        auto dirent = new Dirent();
+        dirent->setStrings(path, title, redirectPath);
+        return dirent;
+      }
+      return producer.pool.getDirent(path, title, redirectPath);
+    }
+
+    Dirent* CreatorData::createDirent(Producer& producer, char ns, const std::string& path, const std::string& mimetype, const std::string& title)
+    {
+      auto dirent = newDirent(producer, path, title, std::string());
       dirent->setNamespace(ns);
-      dirent->setPath(path);
       dirent->setMimeType(getMimeTypeIdx(mimetype));
-      dirent->setTitle(title);
-      addDirent(dirent);
+      addDirent(producer, dirent);
       return dirent;
     }
 
-    Dirent* CreatorData::createItemDirent(const Item* item)
+    Dirent* CreatorData::createItemDirent(Producer& producer, const Item* item)
     {
       auto path = item->getPath();
       auto mimetype = item->getMimeType();
@@ -561,52 +1446,366 @@ int mode =  _S_IREAD | _S_IWRITE;
         std::cerr << "Warning, " << item->getPath() << " have empty mimetype." << std::endl;
         mimetype = "application/octet-stream";
       }
-      return createDirent('C', item->getPath(), mimetype, item->getTitle());
+      return createDirent(producer, 'C', item->getPath(), mimetype, item->getTitle());
     }
 
-    Dirent* CreatorData::createRedirectDirent(char ns, const std::string& path, const std::string& title, char targetNs, const std::string& targetPath)
+    Dirent* CreatorData::createRedirectDirent(Producer& producer, char ns, const std::string& path, const std::string& title, char targetNs, const std::string& targetPath)
     {
-      auto dirent = pool.getDirent();
+      auto dirent = newDirent(producer, path, title, targetPath);
       dirent->setNamespace(ns);
-      dirent->setPath(path);
-      dirent->setTitle(title);
       dirent->setRedirectNs(targetNs);
-      dirent->setRedirectPath(targetPath);
       dirent->setRedirect(nullptr);
-      addDirent(dirent);
-      return dirent;
+      addDirent(producer, dirent);
+      // External dirents are not kept in memory.
+      return externalDirents ? nullptr : dirent;
     }
 
-    Cluster* CreatorData::closeCluster(bool compressed)
+    Cluster* CreatorData::closeCluster(Producer& producer, bool compressed)
     {
       Cluster *cluster;
-      nbClusters++;
       if (compressed )
       {
-        cluster = compCluster;
+        cluster = producer.compCluster;
+        queueCluster(cluster, compressed, producer.pendingCompDirents);
+      } else {
+        cluster = producer.uncompCluster;
+        queueCluster(cluster, compressed, producer.pendingUncompDirents);
+      }
+      if (compressed)
+      {
+        cluster = producer.compCluster = new Cluster(compression, clusterFrameSize);
+      } else {
+        cluster = producer.uncompCluster = new Cluster(zimcompNone);
+      }
+      return cluster;
+    }
+
+    void CreatorData::queueCluster(Cluster* cluster, bool compressed, std::vector<Dirent*>& pendingDirents)
+    {
+      nbClusters++;
+      if (compressed) {
         nbCompClusters++;
+        cluster->setCompressionLevel(adaptiveLevel
+          ? adaptiveLevel->nextLevel(taskList.size())
+          : compressionLevel);
       } else {
-        cluster = uncompCluster;
         nbUnCompClusters++;
       }
-      cluster->setClusterIndex(cluster_index_t(clustersList.size()));
-      clustersList.push_back(cluster);
+      if (!cluster->isStreamed()) {
+        // Wait for the workers and the writer if too much data is pending.
+        // (The content of a streamed cluster is not kept in memory.)
+        clusterMemory.reserve(cluster->getDataSize().v);
+      }
+      {
+        std::lock_guard<std::mutex> l(clustersMutex);
+        cluster->setClusterIndex(cluster_index_t(clustersList.size()));
+        clustersList.push_back(cluster);
+        if (externalDirents) {
+          std::lock_guard<std::mutex> l(externalDirentsMutex);
+          for (auto dirent: pendingDirents) {
+            externalDirents->add(*dirent);
+            delete dirent;
+          }
+          pendingDirents.clear();
+        }
+
+        if (cluster->is_extended() )
+          isExtended = true;
+      }
+
+      // The queues block while they are full: push without the lock, the
+      // other producers (closing a cluster or resolving a deduplicated
+      // dirent) must not wait for the workers.
+      // (With several producers, clusters may be queued out of index
+      // order. The cluster pointers are stored by index, the order of the
+      // clusters in the file doesn't matter.)
       taskList.pushToQueue(new ClusterTask(cluster));
       clusterToWrite.pushToQueue(cluster);
+    }
 
-      if (cluster->is_extended() )
-        isExtended = true;
-      if (compressed)
-      {
-        cluster = compCluster = new Cluster(compression);
-      } else {
-        cluster = uncompCluster = new Cluster(zimcompNone);
+    void CreatorData::setCompressionLevel(int level, double adaptiveTargetMBps, unsigned nbWorkers)
+    {
+      compressionLevel = level;
+      adaptiveLevel.reset();
+      if (adaptiveTargetMBps <= 0) {
+        return;
+      }
+      int minLevel, maxLevel;
+      switch(compression) {
+        case zimcompLzma:
+          minLevel = LZMA_INFO::min_level();
+          maxLevel = LZMA_INFO::max_level();
+          break;
+        case zimcompZstd:
+          minLevel = ZSTD_INFO::min_level();
+          maxLevel = ZSTD_INFO::max_level();
+          break;
+        default:
+          // Nothing to adapt.
+          return;
+      }
+      if (level >= minLevel && level < maxLevel) {
+        maxLevel = level;
+      }
+      adaptiveLevel.reset(new AdaptiveCompressionLevel(minLevel, maxLevel, adaptiveTargetMBps, nbWorkers));
+    }
+
+    void CreatorData::reportCompression(const Cluster* cluster, zsize_t rawSize, double seconds)
+    {
+      compressedRawSize += rawSize.v;
+      compressedSize += cluster->getCompressedSize().v;
+      compressionTime += uint64_t(seconds * 1000000);
+      nbCompressedClusters++;
+      if (adaptiveLevel) {
+        adaptiveLevel->report(cluster->getCompressionLevel(), rawSize, seconds);
       }
-      return cluster;
+    }
+
+    void CreatorData::useExternalDirents(size_type memoryBudget, unsigned nbThreads)
+    {
+      externalDirents.reset(new ExternalDirents(basename + ".zim.dirents.tmp", memoryBudget, nbThreads));
+    }
+
+    void CreatorData::addReusedEntries()
+    {
+      ASSERT(bool(externalDirents), ==, false);
+      auto& archive = *updatedArchive;
+      auto& producer = getProducer();
+
+      // Added entries replace the existing ones.
+      collectDirents();
+      DirentsList added(dirents);
+      std::sort(added.begin(), added.end(), UrlCompare());
+      auto isReplaced = [&](char ns, const std::string& path) {
+        Dirent tmpDirent(ns, path);
+        return std::binary_search(added.begin(), added.end(), &tmpDirent, UrlCompare());
+      };
+      std::sort(removedPaths.begin(), removedPaths.end());
+      auto isRemoved = [&](char ns, const std::string& path) {
+        return ns == 'C' && std::binary_search(removedPaths.begin(), removedPaths.end(), path);
+      };
+      // The indexes written by this creator replace the existing ones. The
+      // other ones are kept as they are (without the changes of the update).
+#if defined(ENABLE_XAPIAN)
+      const bool recreatesTitleIndex = true;
+      const bool recreatesFulltextIndex = withIndex;
+#else
+      const bool recreatesTitleIndex = false;
+      const bool recreatesFulltextIndex = false;
+#endif
+      auto isRecreatedIndex = [&](char ns, const std::string& path) {
+        return ns == 'X'
+            && ((path == "title/xapian" && recreatesTitleIndex)
+             || (path == "fulltext/xapian" && recreatesFulltextIndex));
+      };
+
+      // Clusters used by the reused entries, by index in the updated archive.
+      std::vector<Cluster*> clusters(archive.getCountClusters().v, nullptr);
+#if defined(ENABLE_XAPIAN)
+      // The reused html entries to index, with the position of their content.
+      struct IndexedBlob {
+        cluster_index_type cluster;
+        blob_index_type blob;
+        entry_index_type entry;
+        bool operator<(const IndexedBlob& other) const {
+          return cluster < other.cluster || (cluster == other.cluster && blob < other.blob);
+        }
+      };
+      std::vector<IndexedBlob> toIndex;
+#endif
+      const auto mainPage = archive.getFileheader().getMainPage();
+      for (entry_index_type i=0; i<archive.getCountArticles().v; ++i) {
+        auto oldDirent = archive.getDirent(entry_index_t(i));
+        const auto ns = oldDirent->getNamespace();
+        const auto& path = oldDirent->getUrl();
+        if (isRecreatedIndex(ns, path)
+         || oldDirent->isLinktarget() || oldDirent->isDeleted()
+         || isReplaced(ns, path) || isRemoved(ns, path)) {
+          continue;
+        }
+
+        Dirent* dirent;
+        if (oldDirent->isRedirect()) {
+          auto target = archive.getDirent(oldDirent->getRedirectIndex());
+          if (isRemoved(target->getNamespace(), target->getUrl())
+           && !isReplaced(target->getNamespace(), target->getUrl())) {
+            continue;
+          }
+          dirent = createRedirectDirent(producer, ns, path, oldDirent->getTitle(), target->getNamespace(), target->getUrl());
+        } else {
+          const auto& mimetype = archive.getMimeType(oldDirent->getMimeType());
+          dirent = createDirent(producer, ns, path, mimetype, oldDirent->getTitle());
+          auto clusterNumber = oldDirent->getClusterNumber();
+          auto& cluster = clusters.at(clusterNumber.v);
+          if (!cluster) {
+            cluster = new Cluster(zimcompNone);
+            reusedClusters.push_back(ReusedCluster{archive.getClusterOffset(clusterNumber), zsize_t(0), std::unique_ptr<Cluster>(cluster)});
+          }
+          dirent->setCluster(cluster, oldDirent->getBlobNumber());
+          isEmpty = false;
+
+#if defined(ENABLE_XAPIAN)
+          if (ns == 'C' && mimetype == "text/html") {
+            nbIndexItems++;
+            if (withIndex) {
+              toIndex.push_back(IndexedBlob{clusterNumber.v, oldDirent->getBlobNumber().v, i});
+            }
+          }
+#endif
+        }
+#if defined(ENABLE_XAPIAN)
+        if (ns == 'C' && (oldDirent->isRedirect() || archive.getMimeType(oldDirent->getMimeType()) == "text/html")) {
+          indexTitle(producer, path, oldDirent->getTitle());
+        }
+#endif
+        if (i == mainPage && !mainPageDirent) {
+          mainPageDirent = dirent;
+        }
+        nbReusedEntries++;
+      }
+
+#if defined(ENABLE_XAPIAN)
+      // Index the entries in the order of their content in the archive
+      // (and not in path order). This way the workers decompress each cluster
+      // once (it stays in the cluster cache while its blobs are indexed) and
+      // consecutive clusters are decompressed in parallel.
+      std::sort(toIndex.begin(), toIndex.end());
+      for (const auto& indexed: toIndex) {
+        auto oldDirent = archive.getDirent(entry_index_t(indexed.entry));
+        std::shared_ptr<Item> item(new ReusedItem(updatedArchive, oldDirent->getUrl(), "text/html", oldDirent->getTitle(),
+                                                  cluster_index_t(indexed.cluster), blob_index_t(indexed.blob)));
+        taskList.pushToQueue(new IndexTask(item));
+      }
+#endif
+
+      // Clusters are not prefixed by their size. A cluster ends where the
+      // next part of the file starts: another cluster, the dirents (which
+      // are contiguous, starting with the first one), a table or the end
+      // of the file.
+      const auto& header = archive.getFileheader();
+      std::vector<offset_type> starts;
+      for (cluster_index_type i=0; i<archive.getCountClusters().v; ++i) {
+        starts.push_back(archive.getClusterOffset(cluster_index_t(i)).v);
+      }
+      if (archive.getCountArticles().v) {
+        starts.push_back(archive.getDirentOffset(entry_index_t(0)).v);
+      }
+      starts.push_back(header.getMimeListPos());
+      starts.push_back(header.getUrlPtrPos());
+      starts.push_back(header.getTitleIdxPos());
+      starts.push_back(header.getClusterPtrPos());
+      if (header.hasChecksum()) {
+        starts.push_back(header.getChecksumPos());
+      }
+      starts.push_back(archive.getFilesize().v);
+      std::sort(starts.begin(), starts.end());
+      for (auto& reused: reusedClusters) {
+        ASSERT(reused.offset.v, <, starts.back());
+        auto end = std::upper_bound(starts.begin(), starts.end(), reused.offset.v);
+        reused.size = zsize_t(*end - reused.offset.v);
+      }
+    }
+
+    void CreatorData::copyReusedClusters()
+    {
+      auto fd = DEFAULTFS::openFile(updatedArchive->getFilename());
+      std::unique_ptr<char[]> buffer;
+      for (auto& reused: reusedClusters) {
+        char clusterInfo;
+        if (fd.readAt(&clusterInfo, zsize_t(1), reused.offset).v != 1) {
+          throw std::runtime_error("Error reading " + updatedArchive->getFilename());
+        }
+        if (clusterInfo & 0x10) {
+          isExtended = true;
+        }
+
+        auto cluster = reused.cluster.release();
+        cluster->setOffset(offset_t(lseek(out_fd, 0, SEEK_CUR)));
+        cluster->setClusterIndex(cluster_index_t(clustersList.size()));
+        clustersList.push_back(cluster);
+        nbClusters++;
+
+        auto copied = fd.copyTo(out_fd, reused.offset, reused.size).v;
+        // Copy what the system couldn't copy through a buffer.
+        while (copied < reused.size.v) {
+          if (!buffer) {
+            buffer.reset(new char[COPY_BUFFER_SIZE]);
+          }
+          auto size = std::min(COPY_BUFFER_SIZE, reused.size.v - copied);
+          if (fd.readAt(buffer.get(), zsize_t(size), reused.offset + offset_t(copied)).v != size) {
+            throw std::runtime_error("Error reading " + updatedArchive->getFilename());
+          }
+          _write(out_fd, buffer.get(), size);
+          copied += size;
+        }
+        nbWrittenClusters++;
+        writtenSize += copied;
+      }
+      reusedClusters.clear();
+    }
+
+    entry_index_type CreatorData::getMainPageIndex() const
+    {
+      if (mainPageDirent) {
+        return mainPageDirent->getIdx().v;
+      }
+      if (externalDirents) {
+        return externalDirents->getMainPageIndex();
+      }
+      return std::numeric_limits<entry_index_type>::max();
+    }
+
+    void CreatorData::sortDirents(unsigned nbThreads)
+    {
+      if (externalDirents) {
+        // Done by ExternalDirents::resolve.
+        return;
+      }
+      // The title order doesn't depend on the url order, so both are sorted
+      // at the same time. Dirents removed later are filtered out of
+      // titleIdx in createTitleIndex.
+      const unsigned titleThreads = std::max(nbThreads/2, 1U);
+      titleIdx = dirents;
+      auto titleSort = std::async(std::launch::async,
+        parallelStableSort<DirentsList::iterator, TitleCompare>,
+        titleIdx.begin(), titleIdx.end(), TitleCompare(), titleThreads);
+      parallelStableSort(dirents.begin(), dirents.end(), UrlCompare(), std::max(nbThreads-titleThreads, 1U));
+      titleSort.get();
+      removeDuplicates();
+    }
+
+    // Keep only one dirent per url: the first one added, unless it is a
+    // redirection and an item is added later for the same url.
+    // The sort is stable so dirents with the same url are in insertion order.
+    void CreatorData::removeDuplicates()
+    {
+      auto out = dirents.begin();
+      for (auto dirent: dirents) {
+        if (out != dirents.begin() && !compareUrl(*(out-1), dirent)) {
+          Dirent* existing = *(out-1);
+          if (existing->isRedirect() && !dirent->isRedirect()) {
+            existing->markRemoved();
+            *(out-1) = dirent;
+          } else {
+            std::cerr << "Impossible to add " << dirent->getNamespace() << "/" << dirent->getPath() << std::endl;
+            std::cerr << "  dirent's title to add is : " << dirent->getTitle() << std::endl;
+            std::cerr << "  existing dirent's title is : " << existing->getTitle() << std::endl;
+            dirent->markRemoved();
+          }
+          continue;
+        }
+        *out++ = dirent;
+      }
+      dirents.erase(out, dirents.end());
     }
 
     void CreatorData::setEntryIndexes()
     {
+      if (externalDirents) {
+        // Done by ExternalDirents::resolve.
+        return;
+      }
+
       // set index
       INFO("set index");
       entry_index_t idx(0);
@@ -618,32 +1817,66 @@ int mode =  _S_IREAD | _S_IWRITE;
 
     void CreatorData::resolveRedirectIndexes()
     {
+      if (externalDirents) {
+        externalDirents->resolve();
+        return;
+      }
       // translate redirect aid to index
       INFO("Resolve redirect");
-      for (auto dirent: unresolvedRedirectDirents)
+      for (auto dirent: dirents)
       {
+        if (!dirent->isRedirect()) {
+          continue;
+        }
         Dirent tmpDirent(dirent->getRedirectNs(), dirent->getRedirectPath());
-        auto target_pos = dirents.find(&tmpDirent);
-        if(target_pos == dirents.end()) {
+        auto target_pos = std::lower_bound(dirents.begin(), dirents.end(), &tmpDirent, UrlCompare());
+        if(target_pos == dirents.end() || compareUrl(&tmpDirent, *target_pos)) {
           INFO("Invalid redirection "
               << dirent->getNamespace() << '/' << dirent->getPath()
               << " redirecting to (missing) "
               << dirent->getRedirectNs() << '/' << dirent->getRedirectPath());
-          dirents.erase(dirent);
-          if (dirent == mainPageDirent) {
-            mainPageDirent = nullptr;
-          }
+          dirent->markRemoved();
         } else  {
           dirent->setRedirect(*target_pos);
         }
       }
+
+      // A redirection to a removed redirection is invalid too.
+      bool changed = true;
+      while (changed) {
+        changed = false;
+        for (auto dirent: dirents)
+        {
+          if (dirent->isRedirect() && !dirent->isRemoved()
+           && dirent->getRedirectDirent()->isRemoved()) {
+            INFO("Invalid redirection "
+                << dirent->getNamespace() << '/' << dirent->getPath()
+                << " redirecting to (invalid) "
+                << dirent->getRedirectNs() << '/' << dirent->getRedirectPath());
+            dirent->markRemoved();
+            changed = true;
+          }
+        }
+      }
+
+      dirents.erase(
+        std::remove_if(dirents.begin(), dirents.end(), [](const Dirent* d) { return d->isRemoved(); }),
+        dirents.end());
+      if (mainPageDirent && mainPageDirent->isRemoved()) {
+        mainPageDirent = nullptr;
+      }
     }
 
     void CreatorData::createTitleIndex()
     {
-      titleIdx.clear();
-      for (auto dirent: dirents)
-        titleIdx.insert(dirent);
+      if (externalDirents) {
+        // Done by ExternalDirents::resolve.
+        return;
+      }
+      // titleIdx is sorted in sortDirents.
+      titleIdx.erase(
+        std::remove_if(titleIdx.begin(), titleIdx.end(), [](const Dirent* d) { return d->isRemoved(); }),
+        titleIdx.end());
     }
 
     void CreatorData::resolveMimeTypes()
@@ -669,6 +1902,11 @@ int mode =  _S_IREAD | _S_IWRITE;
         }
       }
 
+      if (externalDirents) {
+        externalDirents->setMimeTypesMapping(mapping);
+        return;
+      }
+
       for (auto& dirent: dirents)
       {
         if (dirent->isItem())
@@ -678,6 +1916,7 @@ int mode =  _S_IREAD | _S_IWRITE;
 
     uint16_t CreatorData::getMimeTypeIdx(const std::string& mimeType)
     {
+      std::lock_guard<std::mutex> l(mimeTypesMutex);
       auto it = mimeTypesMap.find(mimeType);
       if (it == mimeTypesMap.end())
       {
@@ -21,18 +21,26 @@
 #define ZIM_WRITER_CREATOR_DATA_H
 
 #include <zim/writer/item.h>
+#include <zim/writer/creator.h>
 #include "queue.h"
 #include "_dirent.h"
 #include "workers.h"
-#include <set>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <fstream>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include "config.h"
 
 #include "../fileheader.h"
+#include "../sha256.h"
 #include "direntPool.h"
+#include "adaptiveCompression.h"
+#include "externalDirents.h"
 
 #if defined(ENABLE_XAPIAN)
   #include "xapianIndexer.h"
@@ -40,6 +48,8 @@
 
 namespace zim
 {
+  class FileImpl;
+
   namespace writer
   {
     struct UrlCompare {
@@ -48,9 +58,11 @@ namespace zim
       }
     };
 
+    // Entries with the same title are sorted by url.
     struct TitleCompare {
       bool operator() (const Dirent* d1, const Dirent* d2) const {
-        return compareTitle(d1, d2);
+        return compareTitle(d1, d2)
+          || (!compareTitle(d2, d1) && compareUrl(d1, d2));
       }
     };
 
@@ -59,30 +71,73 @@ namespace zim
     class CreatorData
     {
       public:
-        typedef std::set<Dirent*, UrlCompare> UrlSortedDirents;
-        typedef std::multiset<Dirent*, TitleCompare> TitleSortedDirents;
+        typedef std::vector<Dirent*> DirentsList;
         typedef std::map<std::string, uint16_t> MimeTypesMap;
         typedef std::map<uint16_t, std::string> RMimeTypesMap;
         typedef std::vector<std::string> MimeTypesList;
         typedef std::vector<Cluster*> ClusterList;
-        typedef Queue<Cluster*> ClusterQueue;
         typedef Queue<Task*> TaskQueue;
         typedef std::vector<std::thread> ThreadList;
+        struct Producer;
 
         CreatorData(const std::string& fname, bool verbose,
                        bool withIndex, std::string language,
-                       CompressionType compression);
+                       CompressionType compression,
+                       size_type clusterFrameSize,
+                       unsigned nbWorkers);
         virtual ~CreatorData();
 
-        void addDirent(Dirent* dirent);
-        void addItemData(Dirent* dirent, std::unique_ptr<ContentProvider> provider, bool compressContent);
-        void addData(char ns, const std::string& path, const std::string& mimetype, std::unique_ptr<ContentProvider> provider, bool compressContent);
+        // The producer of the calling thread (created on first call).
+        Producer& getProducer();
+
+        void addDirent(Producer& producer, Dirent* dirent);
+        // Add an item with its provider. `content` is the content of the
+        // provider if it is already read in memory (shared with the indexer).
+        void addItem(std::shared_ptr<Item> item, std::unique_ptr<ContentProvider> provider,
+                     std::shared_ptr<const std::string> content);
+        void addItemData(Producer& producer, Dirent* dirent, std::unique_ptr<ContentProvider> provider, bool compressContent);
+        // Put the item data in the current cluster.
+        void packItemData(Producer& producer, Dirent* dirent, std::unique_ptr<ContentProvider> provider, bool compressContent);
+        // Put the items of the clustering window in clusters.
+        void packPendingItems(Producer& producer);
+        struct DedupContent;
+        // Make the dirent point to the same content already added, if any.
+        // Else, `provider` may be replaced by a provider of the (read)
+        // content and `dedupContent` describes the content (size is 0 if
+        // the content is not checked).
+        bool deduplicate(Producer& producer, Dirent* dirent, std::unique_ptr<ContentProvider>& provider,
+                         DedupContent& dedupContent);
+        void addData(Producer& producer, char ns, const std::string& path, const std::string& mimetype, std::unique_ptr<ContentProvider> provider, bool compressContent);
+        // Decide if the content should be compressed from the entropy of its
+        // beginning (see Creator::configCompressionDetection).
+        // `mimetypeDecision` is returned for the items too small to be
+        // sampled. `provider` may be replaced by a provider of the same
+        // content.
+        bool detectCompression(std::unique_ptr<ContentProvider>& provider, bool mimetypeDecision);
 
-        Dirent* createDirent(char ns, const std::string& path, const std::string& mimetype, const std::string& title);
-        Dirent* createItemDirent(const Item* item);
-        Dirent* createRedirectDirent(char ns, const std::string& path, const std::string& title, char targetNs, const std::string& targetPath);
-        Cluster* closeCluster(bool compressed);
+        Dirent* newDirent(Producer& producer, const std::string& path, const std::string& title, const std::string& redirectPath);
+        Dirent* createDirent(Producer& producer, char ns, const std::string& path, const std::string& mimetype, const std::string& title);
+        Dirent* createItemDirent(Producer& producer, const Item* item);
+        Dirent* createRedirectDirent(Producer& producer, char ns, const std::string& path, const std::string& title, char targetNs, const std::string& targetPath);
+        Cluster* closeCluster(Producer& producer, bool compressed);
+        // Give the cluster an index and queue it to be compressed and
+        // written. `pendingDirents` (external dirents of the cluster) are
+        // added to externalDirents.
+        void queueCluster(Cluster* cluster, bool compressed, std::vector<Dirent*>& pendingDirents);
+        // Pack the pending items and close the clusters of all the producers.
+        void closeAllClusters();
+        // Gather the dirents of the producers in `dirents`.
+        void collectDirents();
+        void useExternalDirents(size_type memoryBudget, unsigned nbThreads);
 
+        // Add the entries of the updated archive which are not replaced by
+        // added entries, nor removed.
+        void addReusedEntries();
+        // Copy the clusters of the updated archive used by the reused entries.
+        void copyReusedClusters();
+
+        void sortDirents(unsigned nbThreads);
+        void removeDuplicates();
         void setEntryIndexes();
         void resolveRedirectIndexes();
         void createTitleIndex();
@@ -92,60 +147,193 @@ namespace zim
         const std::string& getMimeType(uint16_t mimeTypeIdx) const;
 
         size_t minChunkSize = 1024-64;
+        // Bigger items are streamed in their own cluster (0 to disable).
+        size_type streamedItemSize = 0;
+        // Numbering of the temporary files of the streamed clusters.
+        std::atomic<unsigned> nbStreamedClusters { 0 };
+        // Number of compressed items grouped before being packed in
+        // clusters (0 to disable, see packPendingItems).
+        size_type clusteringWindow = 0;
+        bool compressionDetection = false;
 
-        DirentPool  pool;
-
-        UrlSortedDirents   dirents;
-        UrlSortedDirents   unresolvedRedirectDirents;
-        TitleSortedDirents titleIdx;
+        // Dirents are gathered from the producers (collectDirents) and sorted
+        // (by url and by title) in sortDirents, once all of them are known.
+        DirentsList        dirents;
+        DirentsList        titleIdx;
         Dirent*            mainPageDirent;
 
+        // Set if dirents are stored out of the memory. Item dirents are
+        // pending (in their producer) until the index of their cluster is
+        // known.
+        std::unique_ptr<ExternalDirents> externalDirents;
+        std::mutex externalDirentsMutex;
+
+        std::mutex mimeTypesMutex;
         MimeTypesMap mimeTypesMap;
         RMimeTypesMap rmimeTypesMap;
         MimeTypesList mimeTypesList;
         uint16_t nextMimeIdx = 0;
 
+        // Protect the closing of the clusters (index, clustersList and
+        // queues), shared by the producers.
+        std::mutex clustersMutex;
         ClusterList clustersList;
         ClusterQueue clusterToWrite;
+        size_t clusterReorderWindow = 0;
+        // Data of the clusters between closeCluster and their writing.
+        MemoryBudget clusterMemory;
         TaskQueue taskList;
         ThreadList workerThreads;
         std::thread  writerThread;
         const CompressionType compression;
+        const size_type clusterFrameSize;
+        int compressionLevel = -1;
+        // Maximum number of threads compressing a big cluster. Only the
+        // idle workers help the thread compressing it (see idleWorkers).
+        unsigned compressionThreads = 1;
+        std::atomic<unsigned> nbBusyWorkers { 0 };
+        std::unique_ptr<AdaptiveCompressionLevel> adaptiveLevel;
         std::string basename;
-        bool isEmpty = true;
+        std::atomic<bool> isEmpty { true };
         bool isExtended = false;
         zsize_t clustersSize;
-        Cluster *compCluster = nullptr;
-        Cluster *uncompCluster = nullptr;
         int out_fd;
 
+        // Content of the added items, by the beginning of their SHA-256
+        // (see deduplicate).
+        struct DedupContent {
+          size_type size = 0;
+          unsigned char sha256[Sha256::DIGEST_SIZE];
+          Cluster* cluster = nullptr;
+          blob_index_t blobNumber;
+        };
+        bool deduplication = false;
+        std::mutex dedupMutex;
+        std::unordered_multimap<uint64_t, DedupContent> dedupContents;
+        // External dirents of duplicated items pointing to a cluster still
+        // open in another producer. They are stored once all the clusters
+        // are closed.
+        std::vector<Dirent*> pendingDedupDirents;
+
+        // The archive updated (see Creator::startZimUpdate), if any, and its
+        // clusters used by the reused entries. They are copied after the new
+        // clusters.
+        struct ReusedCluster {
+          offset_t offset; // In the updated archive
+          zsize_t size;
+          std::unique_ptr<Cluster> cluster;
+        };
+        std::shared_ptr<FileImpl> updatedArchive;
+        std::vector<ReusedCluster> reusedClusters;
+        // Paths of the entries of the updated archive not to keep.
+        std::mutex removedPathsMutex;
+        std::vector<std::string> removedPaths;
+
         bool withIndex;
         std::string indexingLanguage;
 #if defined(ENABLE_XAPIAN)
         XapianIndexer titleIndexer;
         XapianIndexer* indexer = nullptr;
+
+        // Titles are indexed by a dedicated thread (titleIndexerRunner),
+        // they are sent to it by batches.
+        typedef std::vector<std::pair<std::string, std::string>> TitleBatch; // (path, title)
+        typedef Queue<TitleBatch*> TitleBatchQueue;
+        void indexTitle(Producer& producer, const std::string& path, const std::string& title);
+        void flushTitles(Producer& producer);
+        TitleBatchQueue titlesToIndex;
+        std::thread titleIndexerThread;
 #endif
 
+        // Compressed items waiting to be grouped (see packPendingItems).
+        struct PendingItem {
+          Dirent* dirent;
+          std::unique_ptr<ContentProvider> provider;
+        };
+
+        // What a thread adding entries (a producer) works on.
+        // Each producer has its own current clusters and dirents, so
+        // threads adding entries concurrently only share (short) locks to
+        // close a cluster, to get a mimetype index or to deduplicate.
+        struct Producer {
+          Producer(CompressionType compression, size_type clusterFrameSize);
+          ~Producer();
+
+          DirentPool pool;
+          DirentsList dirents;
+          Cluster* compCluster;
+          Cluster* uncompCluster;
+          std::vector<PendingItem> pendingItems;
+          // External dirents waiting for the index of their cluster.
+          std::vector<Dirent*> pendingCompDirents;
+          std::vector<Dirent*> pendingUncompDirents;
+#if defined(ENABLE_XAPIAN)
+          std::unique_ptr<TitleBatch> pendingTitles;
+#endif
+        };
+        // Identify this CreatorData in the producer cache of the threads.
+        const uint64_t id;
+        std::mutex producersMutex;
+        std::vector<std::unique_ptr<Producer>> producers;
+        std::map<std::thread::id, Producer*> threadProducers;
+
         // Some stats
+        // Counters updated while adding entries are atomic: they may be
+        // updated by several producers and read by Creator::getProgress.
         bool verbose;
-        entry_index_type nbItems;
-        entry_index_type nbRedirectItems;
-        entry_index_type nbCompItems;
-        entry_index_type nbUnCompItems;
-        entry_index_type nbIndexItems;
-        cluster_index_type nbClusters;
-        cluster_index_type nbCompClusters;
-        cluster_index_type nbUnCompClusters;
+        std::atomic<entry_index_type> nbDirents { 0 };
+        std::atomic<entry_index_type> nbRedirectItems;
+        std::atomic<entry_index_type> nbCompItems;
+        std::atomic<entry_index_type> nbUnCompItems;
+        std::atomic<entry_index_type> nbIndexItems;
+        std::atomic<cluster_index_type> nbClusters;
+        std::atomic<cluster_index_type> nbCompClusters;
+        std::atomic<cluster_index_type> nbUnCompClusters;
+        std::atomic<cluster_index_type> nbCompressedClusters { 0 };
+        std::atomic<cluster_index_type> nbWrittenClusters { 0 };
         time_t start_time;
+        const std::chrono::steady_clock::time_point startClock = std::chrono::steady_clock::now();
+        std::atomic<size_type> inputSize { 0 };
+        std::atomic<size_type> writtenSize { 0 };
+        std::atomic<size_type> compressedRawSize;
+        std::atomic<size_type> compressedSize;
+        // Time spent by the threads (in microseconds).
+        std::atomic<uint64_t> compressionTime;
+        std::atomic<uint64_t> indexingTime { 0 };
+        std::atomic<uint64_t> titleIndexingTime { 0 };
+        std::atomic<uint64_t> writingTime { 0 };
+        // Items sampled by detectCompression, and those of them compressed
+        // (or not) against their mimetype.
+        std::atomic<entry_index_type> nbSampledItems { 0 };
+        std::atomic<entry_index_type> nbDetectedCompItems { 0 };
+        std::atomic<entry_index_type> nbDetectedUnCompItems { 0 };
+        std::atomic<uint64_t> samplingTime { 0 };
+
+        // Last progress returned (to compute the current throughput).
+        std::mutex progressMutex;
+        Creator::Progress lastProgress;
+        entry_index_type nbReusedEntries = 0;
+        entry_index_type nbDedupCheckedItems = 0;
+        entry_index_type nbDedupItems = 0;
+        size_type dedupSavedSize = 0;
 
         cluster_index_t clusterCount() const
         { return cluster_index_t(clustersList.size()); }
 
         entry_index_t itemCount() const
-        { return entry_index_t(dirents.size()); }
+        { return entry_index_t(externalDirents ? externalDirents->size() : dirents.size()); }
+
+        entry_index_type getMainPageIndex() const;
+
+        unsigned idleWorkers() const {
+          const unsigned busy = nbBusyWorkers;
+          return compressionThreads > busy ? compressionThreads - busy : 0;
+        }
 
         size_t getMinChunkSize()    { return minChunkSize; }
         void setMinChunkSize(size_t s)   { minChunkSize = s; }
+        void setCompressionLevel(int level, double adaptiveTargetMBps, unsigned nbWorkers);
+        void reportCompression(const Cluster* cluster, zsize_t rawSize, double seconds);
     };
 
   }
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_WRITER_DEFAULTINDEXDATA_H
+#define ZIM_WRITER_DEFAULTINDEXDATA_H
+
+#include "config.h"
+
+#include <zim/writer/item.h>
+#include <zim/writer/contentProvider.h>
+
+#if defined(ENABLE_XAPIAN)
+  #include "xapian/myhtmlparse.h"
+#endif
+
+#include <memory>
+#include <string>
+
+namespace zim
+{
+  namespace writer
+  {
+    /**
+     * The IndexData returned by the default `Item::getIndexData`.
+     *
+     * The html content is parsed on first access only.
+     * It comes from the content provider of the item, unless the creator
+     * already read the content (to put it in a cluster) and supplies it
+     * with `SuppliedContent`. This way the content is read only once.
+     */
+    class DefaultIndexData : public IndexData {
+      public:
+        DefaultIndexData(std::unique_ptr<ContentProvider> provider, const std::string& title);
+        DefaultIndexData(std::shared_ptr<const std::string> content, const std::string& title);
+
+        bool hasIndexData() const;
+        std::string getTitle() const;
+        std::string getContent() const;
+        std::string getKeywords() const;
+        uint32_t getWordCount() const;
+        std::tuple<bool, double, double> getGeoPosition() const;
+
+      private:
+        void parse() const;
+
+        mutable std::unique_ptr<ContentProvider> provider;
+        mutable std::shared_ptr<const std::string> content;
+#if defined(ENABLE_XAPIAN)
+        mutable zim::MyHtmlParser htmlParser;
+#endif
+        mutable bool parsed = false;
+        std::string title;
+    };
+
+    /**
+     * The content of the item the calling thread gets the index data of,
+     * while this object lives.
+     *
+     * The default `Item::getIndexData` uses it instead of creating a
+     * content provider of the item (which may open a file or start to
+     * fetch the content again).
+     */
+    class SuppliedContent {
+      public:
+        explicit SuppliedContent(std::shared_ptr<const std::string> content);
+        ~SuppliedContent();
+        SuppliedContent(const SuppliedContent&) = delete;
+        SuppliedContent& operator=(const SuppliedContent&) = delete;
+
+        static std::shared_ptr<const std::string> get();
+    };
+  }
+}
+
+#endif // ZIM_WRITER_DEFAULTINDEXDATA_H
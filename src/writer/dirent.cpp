@@ -18,55 +18,169 @@
  */
 
 #include "_dirent.h"
+#include "externalSort.h"
 #include <zim/zim.h>
 #include "buffer.h"
 #include "endian_tools.h"
 #include "log.h"
 #include <algorithm>
 #include <cstring>
-#ifdef _WIN32
-# include <io.h>
-#else
-# include <unistd.h>
-# define _write(fd, addr, size) if(::write((fd), (addr), (size)) != (ssize_t)(size)) \
-{throw std::runtime_error("Error writing");}
-#endif
 
 log_define("zim.dirent")
 
-void zim::writer::Dirent::write(int out_fd) const
+zim::writer::Dirent::Dirent(const Dirent& other)
+  : mimeType(other.mimeType),
+    ns(other.ns),
+    redirectNs(other.redirectNs),
+    removed(other.removed),
+    ownStrings(false),
+    pathSize(other.pathSize),
+    titleSize(other.titleSize),
+    redirectPathSize(other.redirectPathSize),
+    strings(other.strings),
+    info(other.info),
+    cluster(other.cluster),
+    idx(other.idx),
+    offset(other.offset)
 {
-  union
-  {
-    char d[16];
-    long a;
-  } header;
-  zim::toLittleEndian(getMimeType(), header.d);
-  header.d[2] = 0; // parameter size
-  header.d[3] = getNamespace();
+  // Strings in an arena can be shared, owned ones are copied.
+  if (other.ownStrings) {
+    const auto size = pathSize + titleSize + redirectPathSize + 3;
+    auto copy = new char[size];
+    memcpy(copy, other.strings, size);
+    strings = copy;
+    ownStrings = true;
+  }
+}
 
-  log_debug("title=" << dirent.getTitle() << " title.size()=" << dirent.getTitle().size());
+zim::writer::Dirent::Dirent(Dirent&& other)
+  : Dirent()
+{
+  swap(other);
+}
 
-  zim::toLittleEndian(getVersion(), header.d + 4);
+zim::writer::Dirent& zim::writer::Dirent::operator=(Dirent other)
+{
+  swap(other);
+  return *this;
+}
+
+void zim::writer::Dirent::swap(Dirent& other)
+{
+  std::swap(mimeType, other.mimeType);
+  std::swap(ns, other.ns);
+  std::swap(redirectNs, other.redirectNs);
+  std::swap(removed, other.removed);
+  std::swap(ownStrings, other.ownStrings);
+  std::swap(pathSize, other.pathSize);
+  std::swap(titleSize, other.titleSize);
+  std::swap(redirectPathSize, other.redirectPathSize);
+  std::swap(strings, other.strings);
+  std::swap(info, other.info);
+  std::swap(cluster, other.cluster);
+  std::swap(idx, other.idx);
+  std::swap(offset, other.offset);
+}
+
+void zim::writer::Dirent::releaseStrings()
+{
+  if (ownStrings) {
+    delete[] strings;
+  }
+  strings = nullptr;
+  ownStrings = false;
+}
+
+void zim::writer::Dirent::copyStrings(char* dest, const std::string& path, const std::string& title, const std::string& redirectPath)
+{
+  releaseStrings();
+  pathSize = path.size();
+  titleSize = title.size();
+  redirectPathSize = redirectPath.size();
+  strings = dest;
+  memcpy(dest, path.c_str(), pathSize + 1);
+  dest += pathSize + 1;
+  memcpy(dest, title.c_str(), titleSize + 1);
+  dest += titleSize + 1;
+  memcpy(dest, redirectPath.c_str(), redirectPathSize + 1);
+}
+
+void zim::writer::Dirent::setStrings(const std::string& path, const std::string& title, const std::string& redirectPath)
+{
+  auto dest = new char[stringsSize(path, title, redirectPath)];
+  copyStrings(dest, path, title, redirectPath);
+  ownStrings = true;
+}
+
+void zim::writer::Dirent::serialize(char* dest) const
+{
+  zim::toLittleEndian(getMimeType(), dest);
+  dest[2] = 0; // parameter size
+  dest[3] = getNamespace();
+
+  zim::toLittleEndian(getVersion(), dest + 4);
 
   if (isRedirect())
   {
-    zim::toLittleEndian(getRedirectIndex().v, header.d + 8);
-    _write(out_fd, header.d, 12);
+    zim::toLittleEndian(getRedirectIndex().v, dest + 8);
+    dest += 12;
   }
   else
   {
-    zim::toLittleEndian(zim::cluster_index_type(getClusterNumber()), header.d + 8);
-    zim::toLittleEndian(zim::blob_index_type(getBlobNumber()), header.d + 12);
-    _write(out_fd, header.d, 16);
+    zim::toLittleEndian(zim::cluster_index_type(getClusterNumber()), dest + 8);
+    zim::toLittleEndian(zim::blob_index_type(getBlobNumber()), dest + 12);
+    dest += 16;
   }
 
-  _write(out_fd, path.c_str(), path.size()+1);
+  memcpy(dest, pathData(), pathSize+1);
+  dest += pathSize+1;
+
+  if (!hasPathAsTitle()) {
+    memcpy(dest, titleData(), titleSize);
+    dest += titleSize;
+  }
+  *dest = 0;
+}
 
-  std::string t = getTitle();
-  if (t != path)
-    _write(out_fd, t.c_str(), t.size());
-  char c = 0;
-  _write(out_fd, &c, 1);
+void zim::writer::Dirent::dump(std::ostream& out) const
+{
+  dumpValue(out, ns);
+  dumpValue(out, mimeType);
+  dumpValue(out, idx.v);
+  if (isRedirect()) {
+    dumpValue(out, redirectNs);
+    dumpString(out, getRedirectPath());
+  } else {
+    dumpValue(out, getClusterNumber().v);
+    dumpValue(out, getBlobNumber().v);
+  }
+  dumpString(out, getPath());
+  dumpString(out, std::string(titleData(), titleSize));
+}
 
+bool zim::writer::Dirent::load(std::istream& in)
+{
+  if (!loadValue(in, ns)) {
+    return false;
+  }
+  loadValue(in, mimeType);
+  loadValue(in, idx.v);
+  cluster = nullptr;
+  std::string redirectPath;
+  if (isRedirect()) {
+    info.r.redirectDirent = nullptr;
+    loadValue(in, redirectNs);
+    loadString(in, redirectPath);
+  } else {
+    info.d = DirectInfo();
+    loadValue(in, info.d.clusterNumber.v);
+    loadValue(in, info.d.blobNumber.v);
+  }
+  std::string path, title;
+  loadString(in, path);
+  if (!loadString(in, title)) {
+    throw std::runtime_error("Corrupted temporary dirent file");
+  }
+  setStrings(path, title, redirectPath);
+  return true;
 }
@@ -23,13 +23,46 @@
 #include "debug.h"
 #include "_dirent.h"
 
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace zim
 {
   namespace writer {
+    // Bump allocator for the strings of the dirents.
+    // Memory is only released with the arena, all at once.
+    class StringArena {
+      private:
+        static const size_t CHUNK_SIZE = 1024*1024;
+        std::vector<std::unique_ptr<char[]>> chunks;
+        char* current = nullptr;
+        size_t left = 0;
+
+      public:
+        char* allocate(size_t size) {
+          if (size > CHUNK_SIZE / 4) {
+            // Don't waste the end of the current chunk for a big string.
+            chunks.emplace_back(new char[size]);
+            return chunks.back().get();
+          }
+          if (size > left) {
+            chunks.emplace_back(new char[CHUNK_SIZE]);
+            current = chunks.back().get();
+            left = CHUNK_SIZE;
+          }
+          auto p = current;
+          current += size;
+          left -= size;
+          return p;
+        }
+    };
+
     class DirentPool {
       private:
         std::vector<Dirent*> pools;
         uint16_t direntIndex;
+        StringArena strings;
 
         void allocate_new_pool() {
           pools.push_back(new Dirent[0xFFFF]);
@@ -46,11 +79,15 @@ namespace zim
           }
         }
 
-        Dirent* getDirent() {
+        // The strings of the dirent are stored in the pool.
+        Dirent* getDirent(const std::string& path, const std::string& title, const std::string& redirectPath) {
           if (direntIndex == 0xFFFF) {
             allocate_new_pool();
           }
-          return pools.back() + direntIndex++;
+          auto dirent = pools.back() + direntIndex++;
+          auto dest = strings.allocate(Dirent::stringsSize(path, title, redirectPath));
+          dirent->copyStrings(dest, path, title, redirectPath);
+          return dirent;
         }
     };
   }
@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include "externalDirents.h"
+
+#include "../endian_tools.h"
+#include "../fs.h"
+#include "log.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+# define _write(fd, addr, size) if(::write((fd), (addr), (size)) != (ssize_t)(size)) \
+{throw std::runtime_error("Error writing");}
+#endif
+
+log_define("zim.writer.externalDirents")
+
+#define INFO(e) \
+    do { \
+        log_info(e); \
+        std::cout << e << std::endl; \
+    } while(false)
+
+namespace zim
+{
+  namespace writer
+  {
+    namespace
+    {
+      bool urlLess(char ns1, const std::string& path1, char ns2, const std::string& path2)
+      {
+        return ns1 < ns2 || (ns1 == ns2 && path1 < path2);
+      }
+
+      // Compare the url of a dirent without copying its path.
+      bool urlLess(const Dirent& dirent, char ns, const std::string& path)
+      {
+        return dirent.getNamespace() < ns
+          || (dirent.getNamespace() == ns
+              && lessBytes(dirent.getPathData(), dirent.getPathSize(), path.data(), path.size()));
+      }
+
+      bool urlLess(char ns, const std::string& path, const Dirent& dirent)
+      {
+        return ns < dirent.getNamespace()
+          || (ns == dirent.getNamespace()
+              && lessBytes(path.data(), path.size(), dirent.getPathData(), dirent.getPathSize()));
+      }
+
+      bool sameUrl(const Dirent& dirent, char ns, const std::string& path)
+      {
+        return dirent.getNamespace() == ns
+          && dirent.getPathSize() == path.size()
+          && std::memcmp(dirent.getPathData(), path.data(), path.size()) == 0;
+      }
+
+      void checkOpened(const std::istream& in, const std::string& path)
+      {
+        if (!in) {
+          throw std::runtime_error("Cannot open temporary file " + path);
+        }
+      }
+
+      void checkStream(const std::ostream& out, const std::string& path)
+      {
+        if (!out) {
+          throw std::runtime_error("Error writing temporary file " + path);
+        }
+      }
+
+      // Write data to a fd, batching the writes.
+      class BufferedWriter
+      {
+        public:
+          explicit BufferedWriter(int out_fd)
+            : m_fd(out_fd),
+              m_buffer(BATCH_SIZE),
+              m_used(0)
+          {}
+
+          // Return a place to serialize `size` bytes to.
+          char* reserve(size_t size)
+          {
+            if (m_used + size > m_buffer.size()) {
+              flush();
+              if (size > m_buffer.size()) {
+                m_buffer.resize(size);
+              }
+            }
+            auto dest = m_buffer.data() + m_used;
+            m_used += size;
+            return dest;
+          }
+
+          template<typename T>
+          void addInteger(T value)
+          {
+            toLittleEndian(value, reserve(sizeof(T)));
+          }
+
+          void flush()
+          {
+            if (m_used) {
+              _write(m_fd, m_buffer.data(), m_used);
+              m_used = 0;
+            }
+          }
+
+        private:
+          static const size_t BATCH_SIZE = 1024*1024;
+          int m_fd;
+          std::vector<char> m_buffer;
+          size_t m_used;
+      };
+    }
+
+    void RedirectRecord::dump(std::ostream& out) const
+    {
+      dumpValue(out, ns);
+      dumpValue(out, targetNs);
+      dumpValue(out, idx);
+      dumpValue(out, targetIdx);
+      dumpString(out, path);
+      dumpString(out, targetPath);
+    }
+
+    bool RedirectRecord::load(std::istream& in)
+    {
+      if (!loadValue(in, ns)) {
+        return false;
+      }
+      loadValue(in, targetNs);
+      loadValue(in, idx);
+      loadValue(in, targetIdx);
+      loadString(in, path);
+      if (!loadString(in, targetPath)) {
+        throw std::runtime_error("Corrupted temporary redirection file");
+      }
+      return true;
+    }
+
+    void TitleRecord::dump(std::ostream& out) const
+    {
+      dumpValue(out, ns);
+      dumpValue(out, idx);
+      dumpString(out, title);
+    }
+
+    bool TitleRecord::load(std::istream& in)
+    {
+      if (!loadValue(in, ns)) {
+        return false;
+      }
+      loadValue(in, idx);
+      if (!loadString(in, title)) {
+        throw std::runtime_error("Corrupted temporary title file");
+      }
+      return true;
+    }
+
+    ExternalDirents::ExternalDirents(const std::string& tmpPrefix, size_t memoryBudget, unsigned nbThreads)
+      : m_tmpPrefix(tmpPrefix),
+        m_memoryBudget(memoryBudget),
+        m_nbThreads(nbThreads),
+        m_dirents(tmpPrefix + ".dirents", memoryBudget, nbThreads),
+        m_titles(tmpPrefix + ".titles", memoryBudget, nbThreads),
+        m_redirectTargets(tmpPrefix + ".targets", memoryBudget, nbThreads),
+        m_uniqueDirentsPath(tmpPrefix + ".unique"),
+        m_indexedDirentsPath(tmpPrefix + ".indexed"),
+        m_offsetsPath(tmpPrefix + ".offsets")
+    {}
+
+    ExternalDirents::~ExternalDirents()
+    {
+      DEFAULTFS::removeFile(m_uniqueDirentsPath);
+      DEFAULTFS::removeFile(m_indexedDirentsPath);
+      DEFAULTFS::removeFile(m_offsetsPath);
+    }
+
+    void ExternalDirents::add(const Dirent& dirent)
+    {
+      m_dirents.add(dirent);
+    }
+
+    void ExternalDirents::setMainPage(char ns, const std::string& path)
+    {
+      m_mainPageNs = ns;
+      m_mainPagePath = path;
+    }
+
+    void ExternalDirents::setMimeTypesMapping(const std::vector<uint16_t>& mapping)
+    {
+      m_mimeTypesMapping = mapping;
+    }
+
+    void ExternalDirents::resolve()
+    {
+      RedirectTargetSorter redirects(m_tmpPrefix + ".redirects", m_memoryBudget, m_nbThreads);
+      removeDuplicates(redirects);
+
+      RedirectSourceSorter invalids(m_tmpPrefix + ".invalids", m_memoryBudget, m_nbThreads);
+      findInvalidRedirects(redirects, invalids);
+
+      RedirectTargetSorter validRedirects(m_tmpPrefix + ".valids", m_memoryBudget, m_nbThreads);
+      setEntryIndexes(invalids, validRedirects);
+      resolveRedirectTargets(validRedirects);
+
+      m_titles.sort();
+      m_resolved = true;
+    }
+
+    // Keep only one dirent per url, as CreatorData::addDirent does:
+    // the first one, unless it is a redirection and an item comes later.
+    void ExternalDirents::removeDuplicates(RedirectTargetSorter& redirects)
+    {
+      m_dirents.sort();
+      std::ofstream out(m_uniqueDirentsPath, std::ios::binary);
+      Dirent current;
+      Dirent dirent;
+      bool hasCurrent = false;
+      auto flush = [&]() {
+        current.dump(out);
+        if (current.isRedirect()) {
+          redirects.add(RedirectRecord(current));
+        }
+      };
+      while (m_dirents.next(dirent)) {
+        if (hasCurrent && !compareUrl(&current, &dirent)) {
+          if (current.isRedirect() && !dirent.isRedirect()) {
+            current = std::move(dirent);
+          } else {
+            std::cerr << "Impossible to add " << dirent.getNamespace() << "/" << dirent.getPath() << std::endl;
+            std::cerr << "  dirent's title to add is : " << dirent.getTitle() << std::endl;
+            std::cerr << "  existing dirent's title is : " << current.getTitle() << std::endl;
+          }
+          continue;
+        }
+        if (hasCurrent) {
+          flush();
+        }
+        current = std::move(dirent);
+        hasCurrent = true;
+      }
+      if (hasCurrent) {
+        flush();
+      }
+      out.flush();
+      checkStream(out, m_uniqueDirentsPath);
+    }
+
+    void ExternalDirents::findInvalidRedirects(RedirectTargetSorter& redirects, RedirectSourceSorter& invalids)
+    {
+      INFO("Resolve redirect");
+      // Join the redirections (sorted by target) with the dirents.
+      std::unique_ptr<RedirectTargetSorter> valids(
+        new RedirectTargetSorter(m_tmpPrefix + ".valids0", m_memoryBudget, m_nbThreads));
+      std::unique_ptr<RedirectSourceSorter> newInvalids(
+        new RedirectSourceSorter(m_tmpPrefix + ".invalids0", m_memoryBudget, m_nbThreads));
+      {
+        redirects.sort();
+        std::ifstream in(m_uniqueDirentsPath, std::ios::binary);
+        checkOpened(in, m_uniqueDirentsPath);
+        Dirent dirent;
+        bool hasDirent = dirent.load(in);
+        RedirectRecord redirect;
+        while (redirects.next(redirect)) {
+          while (hasDirent && urlLess(dirent, redirect.targetNs, redirect.targetPath)) {
+            hasDirent = dirent.load(in);
+          }
+          if (hasDirent && sameUrl(dirent, redirect.targetNs, redirect.targetPath)) {
+            valids->add(redirect);
+          } else {
+            INFO("Invalid redirection "
+                << redirect.ns << '/' << redirect.path
+                << " redirecting to (missing) "
+                << redirect.targetNs << '/' << redirect.targetPath);
+            invalids.add(redirect);
+            newInvalids->add(redirect);
+          }
+        }
+      }
+
+      // A redirection to a removed redirection is invalid too.
+      for (unsigned step = 1; newInvalids->size(); ++step) {
+        valids->sort();
+        newInvalids->sort();
+        std::unique_ptr<RedirectTargetSorter> nextValids(
+          new RedirectTargetSorter(m_tmpPrefix + ".valids" + std::to_string(step), m_memoryBudget, m_nbThreads));
+        std::unique_ptr<RedirectSourceSorter> nextInvalids(
+          new RedirectSourceSorter(m_tmpPrefix + ".invalids" + std::to_string(step), m_memoryBudget, m_nbThreads));
+        RedirectRecord invalid;
+        bool hasInvalid = newInvalids->next(invalid);
+        RedirectRecord redirect;
+        while (valids->next(redirect)) {
+          while (hasInvalid && urlLess(invalid.ns, invalid.path, redirect.targetNs, redirect.targetPath)) {
+            hasInvalid = newInvalids->next(invalid);
+          }
+          if (hasInvalid && invalid.ns == redirect.targetNs && invalid.path == redirect.targetPath) {
+            INFO("Invalid redirection "
+                << redirect.ns << '/' << redirect.path
+                << " redirecting to (invalid) "
+                << redirect.targetNs << '/' << redirect.targetPath);
+            invalids.add(redirect);
+            nextInvalids->add(redirect);
+          } else {
+            nextValids->add(redirect);
+          }
+        }
+        valids = std::move(nextValids);
+        newInvalids = std::move(nextInvalids);
+      }
+      invalids.sort();
+    }
+
+    void ExternalDirents::setEntryIndexes(RedirectSourceSorter& invalids, RedirectTargetSorter& redirects)
+    {
+      INFO("set index");
+      std::ifstream in(m_uniqueDirentsPath, std::ios::binary);
+      checkOpened(in, m_uniqueDirentsPath);
+      std::ofstream out(m_indexedDirentsPath, std::ios::binary);
+      RedirectRecord invalid;
+      bool hasInvalid = invalids.next(invalid);
+      Dirent dirent;
+      entry_index_type idx = 0;
+      while (dirent.load(in)) {
+        if (dirent.isRedirect()) {
+          while (hasInvalid && urlLess(invalid.ns, invalid.path, dirent)) {
+            hasInvalid = invalids.next(invalid);
+          }
+          if (hasInvalid && sameUrl(dirent, invalid.ns, invalid.path)) {
+            continue;
+          }
+        }
+        dirent.setIdx(entry_index_t(idx));
+        if (sameUrl(dirent, m_mainPageNs, m_mainPagePath)) {
+          m_mainPageIdx = idx;
+        }
+        if (dirent.isRedirect()) {
+          redirects.add(RedirectRecord(dirent));
+        }
+        m_titles.add(TitleRecord(dirent));
+        dirent.dump(out);
+        ++idx;
+      }
+      out.flush();
+      checkStream(out, m_indexedDirentsPath);
+      m_count = idx;
+      in.close();
+      DEFAULTFS::removeFile(m_uniqueDirentsPath);
+    }
+
+    void ExternalDirents::resolveRedirectTargets(RedirectTargetSorter& redirects)
+    {
+      redirects.sort();
+      std::ifstream in(m_indexedDirentsPath, std::ios::binary);
+      checkOpened(in, m_indexedDirentsPath);
+      Dirent dirent;
+      bool hasDirent = dirent.load(in);
+      RedirectRecord redirect;
+      while (redirects.next(redirect)) {
+        while (hasDirent && urlLess(dirent, redirect.targetNs, redirect.targetPath)) {
+          hasDirent = dirent.load(in);
+        }
+        ASSERT(hasDirent, ==, true);
+        redirect.targetIdx = dirent.getIdx().v;
+        m_redirectTargets.add(std::move(redirect));
+      }
+      m_redirectTargets.sort();
+    }
+
+    void ExternalDirents::writeDirents(int out_fd)
+    {
+      auto offset = offset_type(lseek(out_fd, 0, SEEK_CUR));
+      std::ifstream in(m_indexedDirentsPath, std::ios::binary);
+      checkOpened(in, m_indexedDirentsPath);
+      std::ofstream offsets(m_offsetsPath, std::ios::binary);
+      BufferedWriter writer(out_fd);
+      RedirectRecord redirect;
+      bool hasRedirect = m_redirectTargets.next(redirect);
+      Dirent dirent;
+      Dirent target;
+      while (dirent.load(in)) {
+        if (dirent.isRedirect()) {
+          ASSERT(hasRedirect, ==, true);
+          ASSERT(redirect.idx, ==, dirent.getIdx().v);
+          target.setIdx(entry_index_t(redirect.targetIdx));
+          dirent.setRedirect(&target);
+          hasRedirect = m_redirectTargets.next(redirect);
+        } else {
+          dirent.setMimeType(m_mimeTypesMapping[dirent.getMimeType()]);
+        }
+        dumpValue(offsets, offset);
+        const auto direntSize = dirent.getDirentSize();
+        dirent.serialize(writer.reserve(direntSize));
+        offset += direntSize;
+      }
+      writer.flush();
+      offsets.flush();
+      checkStream(offsets, m_offsetsPath);
+    }
+
+    void ExternalDirents::writeUrlPtrList(int out_fd)
+    {
+      std::ifstream in(m_offsetsPath, std::ios::binary);
+      checkOpened(in, m_offsetsPath);
+      BufferedWriter writer(out_fd);
+      offset_type offset;
+      while (loadValue(in, offset)) {
+        writer.addInteger(offset);
+      }
+      writer.flush();
+    }
+
+    void ExternalDirents::writeTitleIndex(int out_fd)
+    {
+      BufferedWriter writer(out_fd);
+      TitleRecord title;
+      while (m_titles.next(title)) {
+        writer.addInteger(title.idx);
+      }
+      writer.flush();
+    }
+  }
+}
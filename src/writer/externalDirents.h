@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_WRITER_EXTERNALDIRENTS_H
+#define ZIM_WRITER_EXTERNALDIRENTS_H
+
+#include "_dirent.h"
+#include "externalSort.h"
+
+#include <limits>
+
+namespace zim
+{
+  namespace writer
+  {
+    // A redirection between two entries, identified by their urls.
+    struct RedirectRecord
+    {
+      RedirectRecord() = default;
+      RedirectRecord(const Dirent& dirent)
+        : ns(dirent.getNamespace()),
+          path(dirent.getPath()),
+          targetNs(dirent.getRedirectNs()),
+          targetPath(dirent.getRedirectPath()),
+          idx(dirent.getIdx().v)
+      {}
+
+      size_t memorySize() const { return sizeof(RedirectRecord) + path.size() + targetPath.size(); }
+      void dump(std::ostream& out) const;
+      bool load(std::istream& in);
+
+      char ns = 0;
+      std::string path;
+      char targetNs = 0;
+      std::string targetPath;
+      entry_index_type idx = 0;
+      entry_index_type targetIdx = 0;
+    };
+
+    struct TitleRecord
+    {
+      TitleRecord() = default;
+      TitleRecord(const Dirent& dirent)
+        : ns(dirent.getNamespace()),
+          title(dirent.getTitle()),
+          idx(dirent.getIdx().v)
+      {}
+
+      size_t memorySize() const { return sizeof(TitleRecord) + title.size(); }
+      void dump(std::ostream& out) const;
+      bool load(std::istream& in);
+
+      char ns = 0;
+      std::string title;
+      entry_index_type idx = 0;
+    };
+
+    struct DirentUrlOrder {
+      bool operator() (const Dirent& d1, const Dirent& d2) const
+      { return compareUrl(&d1, &d2); }
+    };
+
+    struct RedirectSourceOrder {
+      bool operator() (const RedirectRecord& r1, const RedirectRecord& r2) const
+      { return r1.ns < r2.ns || (r1.ns == r2.ns && r1.path < r2.path); }
+    };
+
+    struct RedirectTargetOrder {
+      bool operator() (const RedirectRecord& r1, const RedirectRecord& r2) const
+      { return r1.targetNs < r2.targetNs || (r1.targetNs == r2.targetNs && r1.targetPath < r2.targetPath); }
+    };
+
+    struct RedirectIndexOrder {
+      bool operator() (const RedirectRecord& r1, const RedirectRecord& r2) const
+      { return r1.idx < r2.idx; }
+    };
+
+    struct TitleRecordOrder {
+      bool operator() (const TitleRecord& t1, const TitleRecord& t2) const
+      { return t1.ns < t2.ns || (t1.ns == t2.ns && t1.title < t2.title); }
+    };
+
+    /**
+     * Dirents of the archive stored outside of the memory.
+     *
+     * This is the counterpart of the `dirents`/`titleIdx` sets of
+     * CreatorData for archives with too many entries to keep them in memory.
+     * Dirents are added once resolved (cluster index known). They are
+     * sorted with ExternalSorter, and all the work done on the sets in memory
+     * (duplicate removal, redirection resolution, entry numbering, title
+     * ordering) is done with sequential passes on temporary files.
+     * The memory used depends on the memory budget (each sorter uses up to
+     * the budget, and at most three of them are filled at the same time),
+     * not on the number of entries. The sorters sort up to `nbThreads` runs
+     * concurrently.
+     */
+    class ExternalDirents
+    {
+      public:
+        ExternalDirents(const std::string& tmpPrefix, size_t memoryBudget, unsigned nbThreads);
+        ~ExternalDirents();
+
+        void add(const Dirent& dirent);
+        void setMainPage(char ns, const std::string& path);
+        void setMimeTypesMapping(const std::vector<uint16_t>& mapping);
+
+        // Sort the dirents, remove duplicated entries and invalid
+        // redirections and set the entry indexes.
+        void resolve();
+
+        // Number of added dirents before `resolve`, number of entries after.
+        entry_index_type size() const { return m_resolved ? m_count : m_dirents.size(); }
+        entry_index_type getMainPageIndex() const { return m_mainPageIdx; }
+
+        void writeDirents(int out_fd);
+        void writeUrlPtrList(int out_fd);
+        void writeTitleIndex(int out_fd);
+
+      private:
+        typedef ExternalSorter<RedirectRecord, RedirectSourceOrder> RedirectSourceSorter;
+        typedef ExternalSorter<RedirectRecord, RedirectTargetOrder> RedirectTargetSorter;
+
+        void removeDuplicates(RedirectTargetSorter& redirects);
+        void findInvalidRedirects(RedirectTargetSorter& redirects, RedirectSourceSorter& invalids);
+        void setEntryIndexes(RedirectSourceSorter& invalids, RedirectTargetSorter& redirects);
+        void resolveRedirectTargets(RedirectTargetSorter& redirects);
+
+        const std::string m_tmpPrefix;
+        const size_t m_memoryBudget;
+        const unsigned m_nbThreads;
+
+        ExternalSorter<Dirent, DirentUrlOrder> m_dirents;
+        ExternalSorter<TitleRecord, TitleRecordOrder> m_titles;
+        ExternalSorter<RedirectRecord, RedirectIndexOrder> m_redirectTargets;
+        std::vector<uint16_t> m_mimeTypesMapping;
+
+        char m_mainPageNs = 0;
+        std::string m_mainPagePath;
+        entry_index_type m_mainPageIdx = std::numeric_limits<entry_index_type>::max();
+
+        bool m_resolved = false;
+        entry_index_type m_count = 0;
+
+        // Temporary files
+        const std::string m_uniqueDirentsPath;
+        const std::string m_indexedDirentsPath;
+        const std::string m_offsetsPath;
+    };
+  }
+}
+
+#endif // ZIM_WRITER_EXTERNALDIRENTS_H
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_WRITER_EXTERNALSORT_H
+#define ZIM_WRITER_EXTERNALSORT_H
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../fs.h"
+
+namespace zim
+{
+  namespace writer
+  {
+    // Helpers to (de)serialize records in temporary files.
+    // Temporary files are read back by the same process, so we use the
+    // native representation.
+    template<typename T>
+    inline void dumpValue(std::ostream& out, const T& value)
+    {
+      out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    inline bool loadValue(std::istream& in, T& value)
+    {
+      return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    inline void dumpString(std::ostream& out, const std::string& value)
+    {
+      dumpValue(out, uint32_t(value.size()));
+      out.write(value.data(), value.size());
+    }
+
+    inline bool loadString(std::istream& in, std::string& value)
+    {
+      uint32_t size;
+      if (!loadValue(in, size)) {
+        return false;
+      }
+      value.resize(size);
+      return size == 0 || bool(in.read(&value[0], size));
+    }
+
+    /**
+     * Sort a collection of records which may not fit in memory.
+     *
+     * Records are buffered in memory. Full buffers are sorted and written to
+     * a temporary file (a run) in background threads while the next buffer
+     * is filled: up to `nbThreads` runs are sorted concurrently. The memory
+     * budget is shared by the buffers being sorted and the one being filled.
+     * Once all the records are added, `sort` merges the runs and the records
+     * are read back, in order, with `next`.
+     * If all the records fit in one buffer, nothing is written to disk.
+     *
+     * The sort is stable: equivalent records come back in insertion order.
+     *
+     * T must provide:
+     *  - `size_t memorySize() const` : the (approximate) memory used by the record.
+     *  - `void dump(std::ostream& out) const`
+     *  - `bool load(std::istream& in)` : return false at the end of the stream.
+     */
+    template<typename T, typename Compare>
+    class ExternalSorter
+    {
+      private: // types
+        class Merger
+        {
+          public:
+            Merger(const std::vector<std::string>& paths, const Compare& compare)
+              : m_compare(compare)
+            {
+              for (auto& path: paths) {
+                std::unique_ptr<Run> run(new Run(path));
+                if (run->head.load(run->in)) {
+                  m_heap.push_back(m_runs.size());
+                }
+                m_runs.push_back(std::move(run));
+              }
+              std::make_heap(m_heap.begin(), m_heap.end(), HeapCompare(*this));
+            }
+
+            bool next(T& record)
+            {
+              if (m_heap.empty()) {
+                return false;
+              }
+              std::pop_heap(m_heap.begin(), m_heap.end(), HeapCompare(*this));
+              auto& run = *m_runs[m_heap.back()];
+              record = std::move(run.head);
+              if (run.head.load(run.in)) {
+                std::push_heap(m_heap.begin(), m_heap.end(), HeapCompare(*this));
+              } else {
+                m_heap.pop_back();
+              }
+              return true;
+            }
+
+          private:
+            struct Run {
+              explicit Run(const std::string& path)
+                : in(path, std::ios::binary)
+              {
+                if (!in) {
+                  throw std::runtime_error("Cannot open temporary file " + path);
+                }
+              }
+              std::ifstream in;
+              T head;
+            };
+
+            // std heap functions build a max heap; the "greatest" run is
+            // the one with the smallest head (the lowest run on ties).
+            struct HeapCompare {
+              explicit HeapCompare(const Merger& merger) : merger(merger) {}
+              bool operator() (size_t a, size_t b) const {
+                const auto& headA = merger.m_runs[a]->head;
+                const auto& headB = merger.m_runs[b]->head;
+                if (merger.m_compare(headB, headA)) return true;
+                if (merger.m_compare(headA, headB)) return false;
+                return b < a;
+              }
+              const Merger& merger;
+            };
+
+            Compare m_compare;
+            std::vector<std::unique_ptr<Run>> m_runs;
+            std::vector<size_t> m_heap;
+        };
+
+      public: // functions
+        ExternalSorter(const std::string& tmpPrefix, size_t memoryBudget,
+                       unsigned nbThreads = 1, Compare compare = Compare())
+          : m_tmpPrefix(tmpPrefix),
+            m_nbThreads(std::max(nbThreads, 1U)),
+            m_bufferLimit(std::max<size_t>(memoryBudget / (m_nbThreads + 1), 1)),
+            m_compare(compare)
+        {}
+
+        ~ExternalSorter()
+        {
+          for (auto& run: m_pendingRuns) {
+            try {
+              run.get();
+            } catch (...) {}
+          }
+          m_merger.reset();
+          for (auto& path: m_runs) {
+            DEFAULTFS::removeFile(path);
+          }
+        }
+
+        void add(T record)
+        {
+          m_bufferMemory += record.memorySize();
+          m_buffer.push_back(std::move(record));
+          ++m_count;
+          if (m_bufferMemory >= m_bufferLimit) {
+            startRun();
+          }
+        }
+
+        size_t size() const { return m_count; }
+
+        void sort()
+        {
+          if (m_runs.empty()) {
+            std::stable_sort(m_buffer.begin(), m_buffer.end(), m_compare);
+            m_current = 0;
+            return;
+          }
+          if (!m_buffer.empty()) {
+            startRun();
+          }
+          while (!m_pendingRuns.empty()) {
+            waitPendingRun();
+          }
+
+          // Limit the number of files open at the same time by merging the
+          // runs in several steps. Consecutive runs are merged together to
+          // keep the sort stable.
+          while (m_runs.size() > MAX_MERGED_RUNS) {
+            std::vector<std::string> runs;
+            for (size_t i=0; i<m_runs.size(); i+=MAX_MERGED_RUNS) {
+              auto end = std::min(i+MAX_MERGED_RUNS, m_runs.size());
+              std::vector<std::string> group(m_runs.begin()+i, m_runs.begin()+end);
+              auto path = newRunPath();
+              runs.push_back(path);
+              {
+                Merger merger(group, m_compare);
+                std::ofstream out(path, std::ios::binary);
+                T record;
+                while (merger.next(record)) {
+                  record.dump(out);
+                }
+                checkStream(out, path);
+              }
+              for (auto& p: group) {
+                DEFAULTFS::removeFile(p);
+              }
+            }
+            m_runs.swap(runs);
+          }
+          m_merger.reset(new Merger(m_runs, m_compare));
+        }
+
+        bool next(T& record)
+        {
+          if (m_merger) {
+            return m_merger->next(record);
+          }
+          if (m_current < m_buffer.size()) {
+            record = std::move(m_buffer[m_current++]);
+            return true;
+          }
+          std::vector<T>().swap(m_buffer);
+          return false;
+        }
+
+      private: // functions
+        std::string newRunPath()
+        {
+          return m_tmpPrefix + "." + std::to_string(m_nextRunId++);
+        }
+
+        static void checkStream(const std::ostream& out, const std::string& path)
+        {
+          if (!out) {
+            throw std::runtime_error("Error writing temporary file " + path);
+          }
+        }
+
+        // Wait for the oldest run being sorted.
+        void waitPendingRun()
+        {
+          auto run = std::move(m_pendingRuns.front());
+          m_pendingRuns.pop_front();
+          run.get();
+        }
+
+        void startRun()
+        {
+          // At most m_nbThreads runs are sorted while the next buffer is
+          // filled. The runs keep their place in m_runs whatever the order
+          // they are written in, the merge stays stable.
+          if (m_pendingRuns.size() >= m_nbThreads) {
+            waitPendingRun();
+          }
+          std::vector<T> records;
+          records.swap(m_buffer);
+          m_bufferMemory = 0;
+          auto path = newRunPath();
+          m_runs.push_back(path);
+          m_pendingRuns.push_back(std::async(std::launch::async, &ExternalSorter::writeRun, this, path, std::move(records)));
+        }
+
+        void writeRun(const std::string& path, std::vector<T> records)
+        {
+          std::stable_sort(records.begin(), records.end(), m_compare);
+          std::ofstream out(path, std::ios::binary);
+          for (auto& record: records) {
+            record.dump(out);
+          }
+          out.flush();
+          checkStream(out, path);
+        }
+
+      private: // data
+        static const size_t MAX_MERGED_RUNS = 128;
+
+        const std::string m_tmpPrefix;
+        const unsigned m_nbThreads;
+        const size_t m_bufferLimit;
+        Compare m_compare;
+
+        std::vector<T> m_buffer;
+        size_t m_bufferMemory = 0;
+        size_t m_count = 0;
+        size_t m_current = 0;
+
+        std::vector<std::string> m_runs;
+        unsigned m_nextRunId = 0;
+        std::deque<std::future<void>> m_pendingRuns;
+        std::unique_ptr<Merger> m_merger;
+    };
+  }
+}
+
+#endif // ZIM_WRITER_EXTERNALSORT_H
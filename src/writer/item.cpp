@@ -17,100 +17,133 @@
  *
  */
 
-#include <zim/writer/item.h>
-#include <zim/writer/contentProvider.h>
-#include "xapian/myhtmlparse.h"
+#include "defaultIndexData.h"
 #include "tools.h"
 
-#include <sstream>
-
 namespace zim
 {
   namespace writer
   {
-    class DefaultIndexData : public IndexData {
-      public:
-        DefaultIndexData(const std::string& htmlData, const std::string& title)
-          : title(title)
-        {
-#if defined(ENABLE_XAPIAN)
-          try {
-            htmlParser.parse_html(htmlData, "UTF-8", true);
-          } catch(...) {}
-#endif
-        }
+    DefaultIndexData::DefaultIndexData(std::unique_ptr<ContentProvider> provider, const std::string& title)
+      : provider(std::move(provider)),
+        title(title)
+    {}
+
+    DefaultIndexData::DefaultIndexData(std::shared_ptr<const std::string> content, const std::string& title)
+      : content(content),
+        title(title)
+    {}
+
+    namespace
+    {
+      thread_local std::shared_ptr<const std::string> suppliedContent;
+    }
+
+    SuppliedContent::SuppliedContent(std::shared_ptr<const std::string> content)
+    {
+      suppliedContent = content;
+    }
 
-        bool hasIndexData() const {
+    SuppliedContent::~SuppliedContent()
+    {
+      suppliedContent.reset();
+    }
+
+    std::shared_ptr<const std::string> SuppliedContent::get()
+    {
+      return suppliedContent;
+    }
+
+    void DefaultIndexData::parse() const
+    {
+      if (parsed) {
+        return;
+      }
+      parsed = true;
 #if defined(ENABLE_XAPIAN)
-          return (htmlParser.dump.find("NOINDEX") == std::string::npos);
-#else
-          return false;
-#endif
+      if (!content) {
+        auto data = std::make_shared<std::string>();
+        data->reserve(provider->getSize());
+        while (true) {
+          auto blob = provider->feed();
+          if(blob.size() == 0) {
+            break;
+          }
+          data->append(blob.data(), blob.size());
         }
+        content = data;
+      }
+      try {
+        htmlParser.parse_html(*content, "UTF-8", true);
+      } catch(...) {}
+#endif
+      provider.reset();
+      content.reset();
+    }
 
-        std::string getTitle() const {
+    bool DefaultIndexData::hasIndexData() const {
 #if defined(ENABLE_XAPIAN)
-          return zim::removeAccents(title);
+      parse();
+      return (htmlParser.dump.find("NOINDEX") == std::string::npos);
 #else
-          return "";
+      return false;
 #endif
-         }
+    }
 
-        std::string getContent() const {
+    std::string DefaultIndexData::getTitle() const {
 #if defined(ENABLE_XAPIAN)
-          return zim::removeAccents(htmlParser.dump);
+      return zim::removeAccents(title);
 #else
-          return "";
+      return "";
 #endif
-        }
+    }
 
-        std::string getKeywords() const {
+    std::string DefaultIndexData::getContent() const {
 #if defined(ENABLE_XAPIAN)
-          return zim::removeAccents(htmlParser.keywords);
+      parse();
+      return zim::removeAccents(htmlParser.dump);
 #else
-          return "";
+      return "";
 #endif
-        }
+    }
 
-        uint32_t getWordCount() const {
+    std::string DefaultIndexData::getKeywords() const {
 #if defined(ENABLE_XAPIAN)
-          return countWords(htmlParser.dump);
+      parse();
+      return zim::removeAccents(htmlParser.keywords);
 #else
-          return 0;
+      return "";
 #endif
-        }
+    }
 
-        std::tuple<bool, double, double> getGeoPosition() const
-        {
+    uint32_t DefaultIndexData::getWordCount() const {
 #if defined(ENABLE_XAPIAN)
-          if(htmlParser.has_geoPosition) {
-            return std::make_tuple(true, htmlParser.latitude, htmlParser.longitude);
-          }
+      parse();
+      return countWords(htmlParser.dump);
+#else
+      return 0;
 #endif
-          return std::make_tuple(false, 0, 0);
-        }
+    }
 
-      private:
+    std::tuple<bool, double, double> DefaultIndexData::getGeoPosition() const
+    {
 #if defined(ENABLE_XAPIAN)
-        zim::MyHtmlParser htmlParser;
+      parse();
+      if(htmlParser.has_geoPosition) {
+        return std::make_tuple(true, htmlParser.latitude, htmlParser.longitude);
+      }
 #endif
-        std::string title;
-
-    };
+      return std::make_tuple(false, 0, 0);
+    }
 
 
     std::unique_ptr<IndexData> Item::getIndexData() const
     {
-      auto provider = getContentProvider();
-      std::ostringstream ss;
-      while (true) {
-        auto blob = provider->feed();
-        if(blob.size() == 0) {
-          break;
-        }
-        ss << blob;
+      if (auto content = SuppliedContent::get()) {
+        return std::unique_ptr<IndexData>(new DefaultIndexData(content, getTitle()));
       }
-      return std::unique_ptr<IndexData>(new DefaultIndexData(ss.str(), getTitle()));
+      // The content is read only when (and if) the index data is used.
+      return std::unique_ptr<IndexData>(new DefaultIndexData(getContentProvider(), getTitle()));
     }
 
     Item::Hints Item::getHints() const {
@@ -125,7 +158,8 @@ namespace zim
 
     std::unique_ptr<IndexData> StringItem::getIndexData() const
     {
-      return std::unique_ptr<IndexData>(new DefaultIndexData(content, title));
+      auto shared_string = std::shared_ptr<const std::string>(shared_from_this(), &content);
+      return std::unique_ptr<IndexData>(new DefaultIndexData(shared_string, title));
     }
 
 
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_WRITER_PARALLELSORT_H
+#define ZIM_WRITER_PARALLELSORT_H
+
+#include <algorithm>
+#include <future>
+
+namespace zim
+{
+  namespace writer
+  {
+    // Stable merge sort using up to nbThreads threads.
+    // The range is split in halves sorted concurrently, then merged.
+    template<typename Iterator, typename Compare>
+    void parallelStableSort(Iterator begin, Iterator end, Compare compare, unsigned nbThreads)
+    {
+      // Not worth a thread under this size.
+      const size_t minParallelSize = 1 << 16;
+      const size_t size = end - begin;
+      if (nbThreads <= 1 || size < minParallelSize) {
+        std::stable_sort(begin, end, compare);
+        return;
+      }
+      const auto middle = begin + size/2;
+      auto firstHalf = std::async(std::launch::async,
+        parallelStableSort<Iterator, Compare>, begin, middle, compare, nbThreads/2);
+      parallelStableSort(middle, end, compare, nbThreads - nbThreads/2);
+      firstHalf.get();
+      std::inplace_merge(begin, middle, end, compare);
+    }
+  }
+}
+
+#endif // ZIM_WRITER_PARALLELSORT_H
@@ -23,9 +23,13 @@
 #define MAX_QUEUE_SIZE 10
 
 #include <mutex>
-#include <queue>
-#include "../tools.h"
+#include <condition_variable>
+#include <deque>
 
+// A bounded blocking queue.
+// `pushToQueue` blocks while the queue is full and the `wait*` methods
+// block while the queue is empty. Waiting threads are woken up as soon as
+// the queue changes, there is no polling.
 template<typename T>
 class Queue {
     public:
@@ -36,10 +40,14 @@ class Queue {
         virtual void pushToQueue(const T& element);
         virtual bool getHead(T &element);
         virtual bool popFromQueue(T &element);
+        virtual void waitForHead(T &element);
+        virtual void waitAndPopFromQueue(T &element);
 
     protected:
-        std::queue<T>   m_realQueue;
+        std::deque<T>   m_realQueue;
         std::mutex      m_queueMutex;
+        std::condition_variable m_notEmpty;
+        std::condition_variable m_notFull;
 
     private:
         // Make this queue non copyable
@@ -61,17 +69,13 @@ size_t Queue<T>::size() {
 
 template<typename T>
 void Queue<T>::pushToQueue(const T &element) {
-    unsigned int wait = 0;
-    unsigned int queueSize = 0;
-
-    do {
-        zim::microsleep(wait);
-        queueSize = size();
-        wait += 10;
-    } while (queueSize > MAX_QUEUE_SIZE);
-
-    std::lock_guard<std::mutex> l(m_queueMutex);
-    m_realQueue.push(element);
+    {
+        std::unique_lock<std::mutex> l(m_queueMutex);
+        m_notFull.wait(l, [this]{ return m_realQueue.size() <= MAX_QUEUE_SIZE; });
+        m_realQueue.push_back(element);
+    }
+    // Consumers may wait for the head or to pop, wake up all of them.
+    m_notEmpty.notify_all();
 }
 
 template<typename T>
@@ -86,15 +90,35 @@ bool Queue<T>::getHead(T &element) {
 
 template<typename T>
 bool Queue<T>::popFromQueue(T &element) {
-    std::lock_guard<std::mutex> l(m_queueMutex);
-    if (m_realQueue.empty()) {
-        return false;
+    {
+        std::lock_guard<std::mutex> l(m_queueMutex);
+        if (m_realQueue.empty()) {
+            return false;
+        }
+
+        element = m_realQueue.front();
+        m_realQueue.pop_front();
     }
+    m_notFull.notify_one();
+    return true;
+}
 
+template<typename T>
+void Queue<T>::waitForHead(T &element) {
+    std::unique_lock<std::mutex> l(m_queueMutex);
+    m_notEmpty.wait(l, [this]{ return !m_realQueue.empty(); });
     element = m_realQueue.front();
-    m_realQueue.pop();
+}
 
-  return true;
+template<typename T>
+void Queue<T>::waitAndPopFromQueue(T &element) {
+    {
+        std::unique_lock<std::mutex> l(m_queueMutex);
+        m_notEmpty.wait(l, [this]{ return !m_realQueue.empty(); });
+        element = m_realQueue.front();
+        m_realQueue.pop_front();
+    }
+    m_notFull.notify_one();
 }
 
 #endif // OPENZIM_LIBZIM_QUEUE_H
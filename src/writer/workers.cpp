@@ -25,10 +25,12 @@
 #include <zim/blob.h>
 #include "../endian_tools.h"
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 
 #if defined(ENABLE_XAPIAN)
   #include "xapianIndexer.h"
+  #include "defaultIndexData.h"
 #endif
 
 #ifdef _WIN32
@@ -46,9 +48,8 @@
 #include "../fs.h"
 #include "../tools.h"
 
-static std::mutex s_dbaccessLock;
-std::atomic<unsigned long> zim::writer::ClusterTask::waiting_task(0);
-std::atomic<unsigned long> zim::writer::IndexTask::waiting_task(0);
+zim::writer::TaskCounter zim::writer::ClusterTask::waiting_task;
+zim::writer::TaskCounter zim::writer::IndexTask::waiting_task;
 
 namespace zim
 {
@@ -62,32 +63,145 @@ namespace zim
     }
 
 
+    void TaskCounter::increment() {
+      std::lock_guard<std::mutex> l(m_mutex);
+      ++m_count;
+    }
+
+    void TaskCounter::decrement() {
+      std::lock_guard<std::mutex> l(m_mutex);
+      if (--m_count == 0) {
+        m_cond.notify_all();
+      }
+    }
+
+    unsigned long TaskCounter::load() {
+      std::lock_guard<std::mutex> l(m_mutex);
+      return m_count;
+    }
+
+    void TaskCounter::waitNoPendingTask() {
+      std::unique_lock<std::mutex> l(m_mutex);
+      m_cond.wait(l, [this]{ return m_count == 0; });
+    }
+
+    void ClusterQueue::notifyClosed() {
+      // Lock to not notify between the check and the wait of the writer.
+      std::lock_guard<std::mutex> l(m_queueMutex);
+      m_notEmpty.notify_all();
+    }
+
+    Cluster* ClusterQueue::waitAndPopClosed(size_t window) {
+      Cluster* cluster = nullptr;
+      {
+        std::unique_lock<std::mutex> l(m_queueMutex);
+        m_notEmpty.wait(l, [&]{
+          const auto end = m_realQueue.size() <= window ? m_realQueue.end() : m_realQueue.begin() + window + 1;
+          for (auto it = m_realQueue.begin(); it != end; ++it) {
+            if (*it == nullptr) {
+              // End marker, the clusters before it are all written.
+              if (it != m_realQueue.begin()) {
+                return false;
+              }
+              m_realQueue.erase(it);
+              return true;
+            }
+            if ((*it)->isClosed()) {
+              cluster = *it;
+              m_realQueue.erase(it);
+              return true;
+            }
+          }
+          return false;
+        });
+        if (!cluster) {
+          return nullptr;
+        }
+      }
+      m_notFull.notify_one();
+      return cluster;
+    }
+
+    void MemoryBudget::setLimit(size_type limit) {
+      std::lock_guard<std::mutex> l(m_mutex);
+      m_limit = limit;
+    }
+
+    void MemoryBudget::reserve(size_type size) {
+      std::unique_lock<std::mutex> l(m_mutex);
+      // Always accept something if nothing is used, even if it is too big.
+      m_cond.wait(l, [&]{ return !m_limit || m_used <= 0 || m_used + int64_t(size) <= int64_t(m_limit); });
+      m_used += size;
+      m_peak = std::max(m_peak, m_used);
+    }
+
+    void MemoryBudget::update(size_type oldSize, size_type newSize) {
+      {
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_used += int64_t(newSize) - int64_t(oldSize);
+        m_peak = std::max(m_peak, m_used);
+      }
+      m_cond.notify_all();
+    }
+
+    void MemoryBudget::release(size_type size) {
+      update(size, 0);
+    }
+
+    size_type MemoryBudget::used() {
+      std::lock_guard<std::mutex> l(m_mutex);
+      return std::max<int64_t>(m_used, 0);
+    }
+
+    size_type MemoryBudget::peak() {
+      std::lock_guard<std::mutex> l(m_mutex);
+      return m_peak;
+    }
+
     void ClusterTask::run(CreatorData* data) {
+      if (cluster->getCompression() == zimcompNone
+       || cluster->getCompression() == zimcompDefault) {
+        cluster->close();
+        data->clusterToWrite.notifyClosed();
+        return;
+      }
+      const auto rawSize = cluster->size();
+      // The memory used by a multithreaded compression grows with the
+      // number of threads: only use the workers with nothing else to do.
+      cluster->setCompressionThreads(1 + data->idleWorkers());
+      const auto start = std::chrono::steady_clock::now();
       cluster->close();
+      const std::chrono::duration<double> duration = elapsed(start);
+      if (!cluster->isStreamed()) {
+        // The content has been replaced by the compressed data.
+        data->clusterMemory.update(cluster->getDataSize().v, cluster->getCompressedSize().v);
+      }
+      data->reportCompression(cluster, rawSize, duration.count());
+      data->clusterToWrite.notifyClosed();
     };
 
 #if defined(ENABLE_XAPIAN)
     void IndexTask::run(CreatorData* data) {
-      Xapian::Stem stemmer;
-      Xapian::TermGenerator indexer;
-      try {
-        stemmer = Xapian::Stem(data->indexer->stemmer_language);
-        indexer.set_stemmer(stemmer);
-        indexer.set_stemming_strategy(Xapian::TermGenerator::STEM_ALL);
-      } catch (...) {
-        // No stemming for language.
+      BusyTimer timer(data->indexingTime);
+      std::unique_ptr<IndexData> indexData;
+      {
+        // Do not read the content again if the item use the default index data.
+        SuppliedContent suppliedContent(m_content);
+        indexData = p_item->getIndexData();
       }
-      indexer.set_stopper(&data->indexer->stopper);
-      indexer.set_stopper_strategy(Xapian::TermGenerator::STOP_ALL);
-
-      auto indexData = p_item->getIndexData();
+      m_content.reset();
 
       if (!indexData->hasIndexData()) {
         return;
       }
 
+      // Each worker indexes in its own shard, no need to lock the database.
+      XapianIndexer::ShardHandle shard(*data->indexer);
+      auto& indexer = shard->termGenerator;
+
       Xapian::Document document;
       indexer.set_document(document);
+      indexer.set_termpos(0);
 
       document.set_data(p_item->getPath());
       document.add_value(0, p_item->getTitle());
@@ -122,8 +236,7 @@ namespace zim
         indexer.index_text_without_positions(indexKeywords, keywordsBoostFactor);
       }
 
-      std::lock_guard<std::mutex> l(s_dbaccessLock);
-      data->indexer->writableDatabase.add_document(document);
+      shard->database.add_document(document);
     }
 #endif
 
@@ -131,46 +244,65 @@ namespace zim
     void* taskRunner(void* arg) {
       auto creatorData = static_cast<zim::writer::CreatorData*>(arg);
       Task* task;
-      unsigned int wait = 0;
 
       while(true) {
-        microsleep(wait);
-        wait += 100;
-        if (creatorData->taskList.popFromQueue(task)) {
-          if (task == nullptr) {
-            return nullptr;
-          }
-          task->run(creatorData);
-          delete task;
-          wait = 0;
+        creatorData->taskList.waitAndPopFromQueue(task);
+        if (task == nullptr) {
+          return nullptr;
         }
+        creatorData->nbBusyWorkers++;
+        task->run(creatorData);
+        delete task;
+        creatorData->nbBusyWorkers--;
       }
       return nullptr;
     }
 
     void* clusterWriter(void* arg) {
       auto creatorData = static_cast<zim::writer::CreatorData*>(arg);
-      Cluster* cluster;
-      unsigned int wait = 0;
       while(true) {
-        microsleep(wait);
-        wait += 100;
-        if(creatorData->clusterToWrite.getHead(cluster)) {
-          if (cluster == nullptr) {
-            // All cluster writen, we can quit
-            return nullptr;
-          }
-          if (not cluster->isClosed()) {
-            continue;
-          }
-          creatorData->clusterToWrite.popFromQueue(cluster);
-          cluster->setOffset(offset_t(lseek(creatorData->out_fd, 0, SEEK_CUR)));
+        auto cluster = creatorData->clusterToWrite.waitAndPopClosed(creatorData->clusterReorderWindow);
+        if (cluster == nullptr) {
+          // All cluster writen, we can quit
+          return nullptr;
+        }
+        {
+          BusyTimer timer(creatorData->writingTime);
+          const auto offset = lseek(creatorData->out_fd, 0, SEEK_CUR);
+          cluster->setOffset(offset_t(offset));
           cluster->write(creatorData->out_fd);
-          cluster->clear_data();
-          wait = 0;
+          creatorData->writtenSize += lseek(creatorData->out_fd, 0, SEEK_CUR) - offset;
         }
+        creatorData->nbWrittenClusters++;
+        cluster->clear_data();
+        if (!cluster->isStreamed()) {
+          creatorData->clusterMemory.release(cluster->isCompressed()
+                                             ? cluster->getCompressedSize().v
+                                             : cluster->getDataSize().v);
+        }
+      }
+      return nullptr;
+    }
+
+#if defined(ENABLE_XAPIAN)
+    void* titleIndexerRunner(void* arg) {
+      auto creatorData = static_cast<zim::writer::CreatorData*>(arg);
+      CreatorData::TitleBatch* batch;
+      while(true) {
+        creatorData->titlesToIndex.waitAndPopFromQueue(batch);
+        if (batch == nullptr) {
+          return nullptr;
+        }
+        {
+          BusyTimer timer(creatorData->titleIndexingTime);
+          for (auto& title: *batch) {
+            creatorData->titleIndexer.indexTitle(title.first, title.second);
+          }
+        }
+        delete batch;
       }
       return nullptr;
     }
+#endif
   }
 }
@@ -20,7 +20,14 @@
 #ifndef OPENZIM_LIBZIM_WORKER_H
 #define OPENZIM_LIBZIM_WORKER_H
 
+#include <mutex>
+#include <condition_variable>
 #include <atomic>
+#include <chrono>
+
+#include <zim/zim.h>
+
+#include "queue.h"
 
 namespace zim {
 namespace writer {
@@ -28,6 +35,90 @@ namespace writer {
 class Cluster;
 class CreatorData;
 
+// Count the pending tasks of a kind and let threads wait (without polling)
+// until all of them are done.
+class TaskCounter {
+  public:
+    TaskCounter() = default;
+
+    void increment();
+    void decrement();
+    unsigned long load();
+    void waitNoPendingTask();
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    unsigned long m_count = 0;
+};
+
+// Memory used by the clusters between their closing and their writing.
+// `reserve` blocks (without polling) while the limit is reached, making the
+// thread closing the clusters wait for the workers and the writer.
+class MemoryBudget {
+  public:
+    MemoryBudget() = default;
+
+    // 0 means no limit.
+    void setLimit(size_type limit);
+    void reserve(size_type size);
+    // Change the memory used by a cluster, without waiting.
+    void update(size_type oldSize, size_type newSize);
+    void release(size_type size);
+    size_type used();
+    size_type peak();
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    size_type m_limit = 0;
+    // Signed: a cluster can be released (by the writer) before its size
+    // is updated (by the worker which compressed it).
+    int64_t m_used = 0;
+    int64_t m_peak = 0;
+};
+
+// The clusters to write, in index order.
+// The writer takes the first closed cluster among the `window`+1 oldest
+// ones, so a cluster slow to compress doesn't delay the writing of the
+// clusters closed after it (the pointer table gives the offset of each
+// cluster, their order in the file doesn't matter).
+class ClusterQueue : public Queue<Cluster*> {
+  public:
+    ClusterQueue() = default;
+
+    // Wake up the writer, a cluster has been closed.
+    void notifyClosed();
+    // Wait for a closed cluster to write and remove it from the queue.
+    // Return nullptr once the end marker (nullptr) is reached.
+    Cluster* waitAndPopClosed(size_t window);
+};
+
+// The time elapsed since `since`.
+// The call to std::chrono::operator- is qualified, the unconstrained
+// zim::operator- template (zim_types.h) would make it ambiguous.
+inline std::chrono::steady_clock::duration elapsed(std::chrono::steady_clock::time_point since)
+{
+  return std::chrono::operator-(std::chrono::steady_clock::now(), since);
+}
+
+// Add the time spent in a scope (in microseconds) to a counter.
+class BusyTimer {
+  public:
+    explicit BusyTimer(std::atomic<uint64_t>& counter)
+      : m_counter(counter),
+        m_start(std::chrono::steady_clock::now())
+    {}
+    ~BusyTimer()
+    {
+      m_counter += std::chrono::duration_cast<std::chrono::microseconds>(elapsed(m_start)).count();
+    }
+
+  private:
+    std::atomic<uint64_t>& m_counter;
+    const std::chrono::steady_clock::time_point m_start;
+};
+
 class Task {
   public:
     Task() = default;
@@ -41,15 +132,15 @@ class ClusterTask : public Task {
     ClusterTask(Cluster* cluster) :
       cluster(cluster)
     {
-      ++waiting_task;
+      waiting_task.increment();
     };
     virtual ~ClusterTask()
     {
-      --waiting_task;
+      waiting_task.decrement();
     }
 
     virtual void run(CreatorData* data);
-    static std::atomic<unsigned long> waiting_task;
+    static TaskCounter waiting_task;
 
   private:
     Cluster* cluster;
@@ -57,25 +148,29 @@ class ClusterTask : public Task {
 
 class IndexTask : public Task {
   public:
-    IndexTask(std::shared_ptr<Item> item) :
-      p_item(item)
+    IndexTask(std::shared_ptr<Item> item, std::shared_ptr<const std::string> content = nullptr) :
+      p_item(item),
+      m_content(content)
     {
-      ++waiting_task;
+      waiting_task.increment();
     }
     virtual ~IndexTask()
     {
-      --waiting_task;
+      waiting_task.decrement();
     }
 
     virtual void run(CreatorData* data);
-    static std::atomic<unsigned long> waiting_task;
+    static TaskCounter waiting_task;
 
   private:
     std::shared_ptr<Item> p_item;
+    // The content of the item, if already read by the creator.
+    std::shared_ptr<const std::string> m_content;
 };
 
 void* taskRunner(void* data);
 void* clusterWriter(void* data);
+void* titleIndexerRunner(void* data);
 
 }
 }
@@ -24,6 +24,7 @@
 #include <sstream>
 #include <fstream>
 #include <stdexcept>
+#include <algorithm>
 #include <cassert>
 
 /* Constructor */
@@ -53,7 +54,9 @@ XapianIndexer::~XapianIndexer()
     try {
 #ifndef _WIN32
 //[TODO] Implement remove for windows
-      zim::DEFAULTFS::remove(indexPath + ".tmp");
+      for (auto& shard: shards) {
+        zim::DEFAULTFS::remove(shard->path);
+      }
       zim::DEFAULTFS::remove(indexPath);
 #endif
     } catch (...) {
@@ -62,41 +65,83 @@ XapianIndexer::~XapianIndexer()
   }
 }
 
-void XapianIndexer::indexingPrelude(const std::string indexPath_)
+XapianIndexer::ShardHandle::ShardHandle(XapianIndexer& indexer)
+  : indexer(indexer)
 {
-  indexPath = indexPath_;
-  writableDatabase = Xapian::WritableDatabase(indexPath + ".tmp", Xapian::DB_CREATE_OR_OVERWRITE);
-  switch (indexingMode) {
-    case IndexingMode::TITLE:
-      writableDatabase.set_metadata("valuesmap", "title:0");
-      writableDatabase.set_metadata("kind", "title");
-      break;
-    case IndexingMode::FULL:
-      writableDatabase.set_metadata("valuesmap", "title:0;wordcount:1;geo.position:2");
-      writableDatabase.set_metadata("kind", "fulltext");
-      break;
+  std::unique_lock<std::mutex> lock(indexer.shardsMutex);
+  indexer.shardReleased.wait(lock, [&]{ return !indexer.freeShards.empty(); });
+  shard = indexer.freeShards.back();
+  indexer.freeShards.pop_back();
+}
+
+XapianIndexer::ShardHandle::~ShardHandle()
+{
+  {
+    std::lock_guard<std::mutex> lock(indexer.shardsMutex);
+    indexer.freeShards.push_back(shard);
   }
-  writableDatabase.set_metadata("language", language);
-  writableDatabase.set_metadata("stopwords", stopwords);
-  writableDatabase.begin_transaction(true);
+  indexer.shardReleased.notify_one();
 }
 
-void XapianIndexer::indexTitle(const std::string& path, const std::string& title)
+void XapianIndexer::indexingPrelude(const std::string indexPath_, unsigned nbShards)
 {
-  assert(indexingMode == IndexingMode::TITLE);
+  indexPath = indexPath_;
   Xapian::Stem stemmer;
-  Xapian::TermGenerator indexer;
+  bool hasStemmer = false;
   try {
     stemmer = Xapian::Stem(stemmer_language);
-    indexer.set_stemmer(stemmer);
-    indexer.set_stemming_strategy(Xapian::TermGenerator::STEM_SOME);
-  } catch (...) {}
-  indexer.set_stopper(&stopper);
-  indexer.set_stopper_strategy(Xapian::TermGenerator::STOP_ALL);
+    hasStemmer = true;
+  } catch (...) {
+    // No stemming for language.
+  }
+  nbShards = std::max(nbShards, 1U);
+  for (unsigned i = 0; i < nbShards; i++) {
+    std::unique_ptr<Shard> shard(new Shard);
+    shard->path = indexPath + ".tmp";
+    if (i > 0) {
+      shard->path += "." + std::to_string(i);
+    }
+    auto& database = shard->database;
+    database = Xapian::WritableDatabase(shard->path, Xapian::DB_CREATE_OR_OVERWRITE);
+    switch (indexingMode) {
+      case IndexingMode::TITLE:
+        database.set_metadata("valuesmap", "title:0");
+        database.set_metadata("kind", "title");
+        break;
+      case IndexingMode::FULL:
+        database.set_metadata("valuesmap", "title:0;wordcount:1;geo.position:2");
+        database.set_metadata("kind", "fulltext");
+        break;
+    }
+    database.set_metadata("language", language);
+    database.set_metadata("stopwords", stopwords);
+    database.begin_transaction(true);
+
+    auto& termGenerator = shard->termGenerator;
+    if (hasStemmer) {
+      termGenerator.set_stemmer(stemmer);
+      termGenerator.set_stemming_strategy(indexingMode == IndexingMode::TITLE
+                                          ? Xapian::TermGenerator::STEM_SOME
+                                          : Xapian::TermGenerator::STEM_ALL);
+    }
+    termGenerator.set_stopper(&stopper);
+    termGenerator.set_stopper_strategy(Xapian::TermGenerator::STOP_ALL);
+
+    freeShards.push_back(shard.get());
+    shards.push_back(std::move(shard));
+  }
+}
+
+void XapianIndexer::indexTitle(const std::string& path, const std::string& title)
+{
+  assert(indexingMode == IndexingMode::TITLE);
+  ShardHandle shard(*this);
+  auto& indexer = shard->termGenerator;
   Xapian::Document currentDocument;
   currentDocument.clear_values();
   currentDocument.set_data(path);
   indexer.set_document(currentDocument);
+  indexer.set_termpos(0);
 
   std::string unaccentedTitle = zim::removeAccents(title);
 
@@ -107,21 +152,27 @@ void XapianIndexer::indexTitle(const std::string& path, const std::string& title
   }
 
   /* add to the database */
-  writableDatabase.add_document(currentDocument);
+  shard->database.add_document(currentDocument);
 }
 
 void XapianIndexer::flush()
 {
-  this->writableDatabase.commit_transaction();
-  this->writableDatabase.begin_transaction(true);
+  for (auto& shard: shards) {
+    shard->database.commit_transaction();
+    shard->database.begin_transaction(true);
+  }
 }
 
 void XapianIndexer::indexingPostlude()
 {
-  this->flush();
-  this->writableDatabase.commit_transaction();
-  this->writableDatabase.commit();
-  this->writableDatabase.compact(indexPath, Xapian::DBCOMPACT_SINGLE_FILE);
-  this->writableDatabase.close();
+  // All the documents have been indexed, we don't need to acquire the shards.
+  Xapian::Database merged;
+  for (auto& shard: shards) {
+    shard->database.commit_transaction();
+    shard->database.commit();
+    shard->database.close();
+    merged.add_database(Xapian::Database(shard->path));
+  }
+  merged.compact(indexPath, Xapian::DBCOMPACT_SINGLE_FILE);
+  merged.close();
 }
-
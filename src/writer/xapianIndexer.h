@@ -26,6 +26,11 @@
 #include <xapian.h>
 #include <zim/blob.h>
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 
 namespace zim {
   namespace writer {
@@ -41,17 +46,47 @@ enum class IndexingMode {
 class XapianIndexer
 {
  public:
+  // A part of the index, with its own database and term generator.
+  // A shard is used by only one thread at a time, so documents can be
+  // indexed in parallel (one shard per thread). The shards are merged in
+  // `indexingPostlude`.
+  struct Shard
+  {
+    std::string path;
+    Xapian::WritableDatabase database;
+    Xapian::TermGenerator termGenerator;
+  };
+
+  // Give a shard not used by other threads for the lifetime of the handle.
+  class ShardHandle
+  {
+   public:
+    explicit ShardHandle(XapianIndexer& indexer);
+    ~ShardHandle();
+    ShardHandle(const ShardHandle&) = delete;
+    ShardHandle& operator=(const ShardHandle&) = delete;
+
+    Shard* operator->() const { return shard; }
+
+   private:
+    XapianIndexer& indexer;
+    Shard* shard;
+  };
+
   XapianIndexer(const std::string& language, IndexingMode mode, bool verbose);
   virtual ~XapianIndexer();
   std::string getIndexPath() { return indexPath; }
-  void indexingPrelude(const std::string indexPath);
+  void indexingPrelude(const std::string indexPath, unsigned nbShards = 1);
   void flush();
   void indexingPostlude();
 
   void indexTitle(const std::string& path, const std::string& title);
 
  protected:
-  Xapian::WritableDatabase writableDatabase;
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::vector<Shard*> freeShards;
+  std::mutex shardsMutex;
+  std::condition_variable shardReleased;
   std::string stemmer_language;
   Xapian::SimpleStopper stopper;
   std::string indexPath;
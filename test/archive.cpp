@@ -24,9 +24,12 @@
 
 #include "tools.h"
 #include "../src/fs.h"
+#include "../src/fileimpl.h"
 
 #include "gtest/gtest.h"
 
+#include <fstream>
+
 namespace
 {
 
@@ -142,6 +145,20 @@ TEST(ZimArchive, wrongChecksumInEmptyZimArchive)
   ASSERT_FALSE(archive.check());
 }
 
+TEST(ZimArchive, checkReportsProgress)
+{
+  const auto tmpfile = makeTempFile("empty_zim_file", emptyZimArchiveContent());
+
+  zim::Archive archive(tmpfile->path());
+  std::vector<std::pair<zim::size_type, zim::size_type>> progress;
+  ASSERT_TRUE(archive.check([&](zim::size_type done, zim::size_type total) {
+    progress.push_back(std::make_pair(done, total));
+  }));
+  ASSERT_EQ(progress.size(), 1U);
+  ASSERT_EQ(progress[0].first, 81U);
+  ASSERT_EQ(progress[0].second, 81U);
+}
+
 TEST(ZimArchive, openRealZimArchive)
 {
   const char* const zimfiles[] = {
@@ -275,6 +292,39 @@ TEST(ZimArchive, validate)
   );
 }
 
+TEST(ZimArchive, validateReportsTheFailedCheck)
+{
+  // A copy of a valid archive with a byte of its first cluster changed:
+  // only the checksum doesn't match.
+  TempFile tmpFile("corrupted_zim");
+  {
+    std::ifstream in("./data/small.zim", std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const zim::Archive archive("./data/small.zim");
+    const auto offset = archive.getImpl()->getClusterOffset(zim::cluster_index_t(0)).v + 10;
+    content[offset] ^= 0xFF;
+    ASSERT_EQ(write(tmpFile.fd(), content.data(), content.size()), ssize_t(content.size()));
+  }
+
+  zim::Archive archive(tmpFile.path());
+  EXPECT_FALSE(archive.checkIntegrity(zim::IntegrityCheck::CHECKSUM));
+  EXPECT_TRUE(archive.checkIntegrity(zim::IntegrityCheck::DIRENT_PTRS));
+  EXPECT_TRUE(archive.checkIntegrity(zim::IntegrityCheck::DIRENT_ORDER));
+  EXPECT_TRUE(archive.checkIntegrity(zim::IntegrityCheck::TITLE_INDEX));
+  EXPECT_TRUE(archive.checkIntegrity(zim::IntegrityCheck::CLUSTER_PTRS));
+
+  zim::IntegrityCheckList all;
+  all.set();
+  {
+    CapturedStderr stderror;
+    EXPECT_FALSE(zim::validate(tmpFile.path(), all));
+    EXPECT_EQ("Checksum doesn't match\n", std::string(stderror));
+  }
+
+  all.reset(size_t(zim::IntegrityCheck::CHECKSUM));
+  EXPECT_TRUE(zim::validate(tmpFile.path(), all));
+}
+
 TEST(ZimArchive, multipart)
 {
   const zim::Archive archive1("./data/wikibooks_be_all_nopic_2017-02.zim");
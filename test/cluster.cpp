@@ -55,6 +55,7 @@
 #include "../src/writer/cluster.h"
 #include "../src/endian_tools.h"
 #include "../src/config.h"
+#include "../src/fs.h"
 
 #include "tools.h"
 
@@ -184,6 +185,51 @@ TEST(ClusterTest, read_write_clusterZstd)
   ASSERT_EQ(blob2, std::string(cluster2.getBlob(zim::blob_index_t(2))));
 }
 
+TEST(ClusterTest, read_write_clusterZstdSeekable)
+{
+  // Use tiny frames to have blobs spanning several frames.
+  zim::writer::Cluster cluster(zim::zimcompZstd, 16);
+  ASSERT_TRUE(cluster.isSeekable());
+
+  std::string blob0("123456789012345678901234567890");
+  std::string blob1("ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+  std::string blob2("abcdefghijklmnopqrstuvwxyz");
+
+  cluster.addContent(blob0);
+  cluster.addContent(blob1);
+  cluster.addContent(blob2);
+
+  cluster.close();
+  auto buffer = write_to_buffer(cluster);
+  ASSERT_EQ(buffer.at(zim::offset_t(0)), 0x25);
+  {
+    const auto cluster2shptr = zim::Cluster::read(zim::BufferReader(buffer), zim::offset_t(0));
+    zim::Cluster& cluster2 = *cluster2shptr;
+    ASSERT_EQ(cluster2.isExtended, false);
+    ASSERT_EQ(cluster2.count().v, 3U);
+    ASSERT_EQ(cluster2.getCompression(), zim::zimcompZstd);
+    ASSERT_EQ(cluster2.getBlobSize(zim::blob_index_t(0)).v, blob0.size());
+    ASSERT_EQ(cluster2.getBlobSize(zim::blob_index_t(1)).v, blob1.size());
+    ASSERT_EQ(cluster2.getBlobSize(zim::blob_index_t(2)).v, blob2.size());
+    ASSERT_EQ(blob2, std::string(cluster2.getBlob(zim::blob_index_t(2))));
+    ASSERT_EQ(blob0, std::string(cluster2.getBlob(zim::blob_index_t(0))));
+    ASSERT_EQ(blob1, std::string(cluster2.getBlob(zim::blob_index_t(1))));
+    ASSERT_EQ(blob1.substr(5, 20),
+              std::string(cluster2.getBlob(zim::blob_index_t(1), zim::offset_t(5), zim::zsize_t(20))));
+  }
+
+  // Without the seekable flag, the cluster is read as a classic zstd stream.
+  const_cast<char*>(buffer.data())[0] = 0x05;
+  {
+    const auto cluster2shptr = zim::Cluster::read(zim::BufferReader(buffer), zim::offset_t(0));
+    zim::Cluster& cluster2 = *cluster2shptr;
+    ASSERT_EQ(cluster2.count().v, 3U);
+    ASSERT_EQ(blob0, std::string(cluster2.getBlob(zim::blob_index_t(0))));
+    ASSERT_EQ(blob1, std::string(cluster2.getBlob(zim::blob_index_t(1))));
+    ASSERT_EQ(blob2, std::string(cluster2.getBlob(zim::blob_index_t(2))));
+  }
+}
+
 class FakeProvider : public zim::writer::ContentProvider
 {
   public:
@@ -348,5 +394,95 @@ TEST(ClusterTest, read_extended_cluster)
   fclose(tmpfile);
 }
 
+#ifndef _WIN32
+// Content of a test file, big enough to be copied directly by the system.
+std::string fileContent(size_t size)
+{
+  std::string content(size, '\0');
+  for (size_t i=0; i<size; i++) {
+    content[i] = char('a' + (i*7 + i/251)%26);
+  }
+  return content;
+}
+
+std::string readFile(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+TEST(ClusterTest, copyFileRange)
+{
+  const auto content = fileContent(300*1024);
+  TempFile in("copy_in");
+  ASSERT_EQ(write(in.fd(), content.data(), content.size()), ssize_t(content.size()));
+  TempFile out("copy_out");
+  ASSERT_EQ(write(out.fd(), "prefix", 6), 6);
+
+  const auto fd = zim::DEFAULTFS::openFile(in.path());
+  const auto copied = fd.copyTo(out.fd(), zim::offset_t(1000), zim::zsize_t(200*1024)).v;
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SENDFILE)
+  ASSERT_EQ(copied, 200U*1024);
+#endif
+  // The content is copied at the current position of the output file.
+  ASSERT_EQ(readFile(out.path()), "prefix" + content.substr(1000, copied));
+}
+
+TEST(ClusterTest, copyFileToPipe)
+{
+  // copy_file_range doesn't copy to a pipe, sendfile is used instead.
+  const auto content = fileContent(32*1024);
+  TempFile in("copy_in");
+  ASSERT_EQ(write(in.fd(), content.data(), content.size()), ssize_t(content.size()));
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+
+  const auto fd = zim::DEFAULTFS::openFile(in.path());
+  const auto copied = fd.copyTo(fds[1], zim::offset_t(0), zim::zsize_t(content.size())).v;
+  close(fds[1]);
+#if defined(HAVE_SENDFILE)
+  ASSERT_EQ(copied, content.size());
+#endif
+  std::string piped(copied, '\0');
+  ASSERT_EQ(read(fds[0], &piped[0], copied), ssize_t(copied));
+  close(fds[0]);
+  ASSERT_EQ(piped, content.substr(0, copied));
+}
+
+TEST(ClusterTest, writeFileProvider)
+{
+  const auto content = fileContent(300*1024);
+  TempFile file("cluster_file");
+  ASSERT_EQ(write(file.fd(), content.data(), content.size()), ssize_t(content.size()));
+
+  // Written to a regular file, written to a file opened in append mode (the
+  // system can't copy the content, it is read by the cluster) and to a
+  // buffer.
+  for (bool append: {false, true}) {
+    zim::writer::Cluster cluster(zim::zimcompNone);
+    cluster.addContent("before");
+    cluster.addContent(std::unique_ptr<zim::writer::ContentProvider>(new zim::writer::FileProvider(file.path())));
+    cluster.addContent("after");
+    cluster.close();
+
+    TempFile out("cluster_out");
+    const int out_fd = append ? open(out.path().c_str(), O_WRONLY|O_APPEND) : out.fd();
+    ASSERT_NE(out_fd, -1);
+    cluster.write(out_fd);
+    if (append) {
+      close(out_fd);
+    }
+
+    const auto data = readFile(out.path());
+    const auto buffer = zim::Buffer::makeBuffer(zim::zsize_t(data.size()));
+    std::copy(data.begin(), data.end(), const_cast<char*>(buffer.data()));
+    const auto cluster2 = zim::Cluster::read(zim::BufferReader(buffer), zim::offset_t(0));
+    ASSERT_EQ(cluster2->count().v, 3U);
+    ASSERT_EQ(std::string(cluster2->getBlob(zim::blob_index_t(0))), "before");
+    ASSERT_EQ(std::string(cluster2->getBlob(zim::blob_index_t(1))), content) << "append: " << append;
+    ASSERT_EQ(std::string(cluster2->getBlob(zim::blob_index_t(2))), "after");
+  }
+}
+#endif
 
 }  // namespace
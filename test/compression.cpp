@@ -100,5 +100,127 @@ TYPED_TEST(CompressionTest, compress) {
   }
 }
 
+TYPED_TEST(CompressionTest, compressIncompressible) {
+  // The compressed data fills the output buffer while the input is fed.
+  std::string data;
+  uint32_t seed = 42;
+  for (int i=0; i<3*1024*1024; i++) {
+    seed = seed * 1103515245 + 12345;
+    data.append(1, (char)(seed >> 24));
+  }
+
+  typename TestFixture::CompressorT compressor(1024);
+  compressor.init(const_cast<char*>(data.c_str()));
+  for (size_t offset=0; offset<data.size(); offset+=1024*1024) {
+    compressor.feed(data.c_str()+offset, 1024*1024);
+  }
+  zim::zsize_t comp_size;
+  auto comp_data = compressor.get_data(&comp_size);
+
+  typename TestFixture::DecompressorT decompressor(1024);
+  decompressor.init(comp_data.get());
+  decompressor.feed(comp_data.get(), comp_size.v);
+  zim::zsize_t decomp_size;
+  auto decomp_data = decompressor.get_data(&decomp_size);
+  ASSERT_EQ(data, std::string(decomp_data.get(), decomp_size.v));
+}
+
+TYPED_TEST(CompressionTest, streamCompress) {
+  std::string data;
+  for (int i=0; i<1000000; i++) {
+    data.append(1, (char)((i*i/7)%61));
+  }
+
+  // Small output buffers to get the compressed data in many chunks.
+  auto bufferSizes = std::vector<size_t>{16, 1024, 1024*1024};
+  for (auto bufferSize: bufferSizes) {
+    std::string comp_data;
+    unsigned nbChunks = 0;
+    zim::StreamCompressor<TypeParam> compressor([&](const char* chunk, size_t size) {
+      ASSERT_LE(size, bufferSize);
+      comp_data.append(chunk, size);
+      nbChunks++;
+    }, bufferSize);
+    compressor.init(const_cast<char*>(data.c_str()));
+    for (size_t offset=0; offset<data.size(); offset+=10000) {
+      compressor.feed(data.c_str()+offset, std::min<size_t>(10000, data.size()-offset));
+    }
+    auto comp_size = compressor.finish();
+    ASSERT_EQ(comp_size.v, comp_data.size());
+    ASSERT_LT(comp_size.v, data.size());
+    if (bufferSize < comp_size.v) {
+      ASSERT_GT(nbChunks, 1U);
+    }
+
+    typename TestFixture::DecompressorT decompressor(1024);
+    decompressor.init(&comp_data[0]);
+    decompressor.feed(&comp_data[0], comp_data.size());
+    zim::zsize_t decomp_size;
+    auto decomp_data = decompressor.get_data(&decomp_size);
+    ASSERT_EQ(data, std::string(decomp_data.get(), decomp_size.v));
+  }
+}
+
+TYPED_TEST(CompressionTest, levels) {
+  std::string data;
+  for (int i=0; i<100000; i++) {
+    data.append(1, (char)((i*i/7)%61));
+  }
+
+  auto levels = std::vector<int>{-1, TypeParam::min_level(), TypeParam::max_level(), TypeParam::max_level()+10};
+  for (auto level: levels) {
+    typename TestFixture::CompressorT compressor(1024);
+    compressor.init(const_cast<char*>(data.c_str()), level);
+    compressor.feed(data.c_str(), data.size());
+    zim::zsize_t comp_size;
+    auto comp_data = compressor.get_data(&comp_size);
+    ASSERT_LT(comp_size.v, data.size());
+
+    typename TestFixture::DecompressorT decompressor(1024);
+    decompressor.init(comp_data.get());
+    decompressor.feed(comp_data.get(), comp_size.v);
+    zim::zsize_t decomp_size;
+    auto decomp_data = decompressor.get_data(&decomp_size);
+    ASSERT_EQ(data, std::string(decomp_data.get(), decomp_size.v));
+  }
+}
+
+std::string lzmaCompress(const std::string& data, int level)
+{
+  zim::Compressor<LZMA_INFO> compressor(1024);
+  compressor.init(const_cast<char*>(data.c_str()), level);
+  compressor.feed(data.c_str(), data.size());
+  zim::zsize_t comp_size;
+  auto comp_data = compressor.get_data(&comp_size);
+  return std::string(comp_data.get(), comp_size.v);
+}
+
+TEST(LzmaCompression, extremeLevel) {
+  // The preset 9 and its extreme variant (the best level) can both be used.
+  std::string data;
+  for (int i=0; i<100000; i++) {
+    data.append(1, (char)((i*i/7)%61));
+  }
+  ASSERT_EQ(LZMA_INFO::max_level(), 10);
+  ASSERT_EQ(lzmaCompress(data, -1), lzmaCompress(data, LZMA_INFO::max_level()));
+  ASSERT_NE(lzmaCompress(data, 9), lzmaCompress(data, LZMA_INFO::max_level()));
+}
+
+TEST(LzmaCompression, mtBlockSize) {
+  // The blocks compressed by the threads are not smaller than the
+  // dictionary of the level.
+  ASSERT_EQ(LZMA_INFO::mt_block_size(-1), 64U*1024*1024);
+  ASSERT_EQ(LZMA_INFO::mt_block_size(LZMA_INFO::max_level()), 64U*1024*1024);
+  ASSERT_EQ(LZMA_INFO::mt_block_size(6), MT_COMPRESSION_BLOCK_SIZE);
+  ASSERT_EQ(LZMA_INFO::mt_block_size(LZMA_INFO::min_level()), MT_COMPRESSION_BLOCK_SIZE);
+}
+
+TEST(LzmaCompression, mtEncoderThreads) {
+  // The memory limit is per thread: the threads are used whatever the level.
+  ASSERT_EQ(LZMA_INFO::mt_encoder_threads(-1, 4), 4U);
+  ASSERT_EQ(LZMA_INFO::mt_encoder_threads(LZMA_INFO::max_level(), 2), 2U);
+  ASSERT_EQ(LZMA_INFO::mt_encoder_threads(6, 4), 4U);
+  ASSERT_EQ(LZMA_INFO::mt_encoder_threads(6, 1), 1U);
+}
 
 }  // namespace
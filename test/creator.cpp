@@ -0,0 +1,1184 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#define ZIM_PRIVATE
+#include <zim/zim.h>
+#include <zim/archive.h>
+#include <zim/item.h>
+#include <zim/error.h>
+#include <zim/writer/creator.h>
+#include <zim/writer/contentProvider.h>
+#if defined(LIBZIM_WITH_XAPIAN)
+#include <zim/search.h>
+#endif
+
+#include "tools.h"
+#include "../src/fileimpl.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+
+using zim::unittests::TempFile;
+
+// The path of a zim file to create, removed at the end of the test with
+// the temporary file of the creator.
+// (The creator needs a path ending with ".zim".)
+class TempZimFile
+{
+  public:
+    explicit TempZimFile(const char* name)
+      : m_tmpFile(name),
+        m_path(m_tmpFile.path() + ".zim")
+    {}
+    ~TempZimFile() {
+      std::remove(m_path.c_str());
+      std::remove((m_path + ".tmp").c_str());
+    }
+
+    const std::string& path() const { return m_path; }
+
+  private:
+    TempFile m_tmpFile;
+    std::string m_path;
+};
+
+std::string itemPath(unsigned i)
+{
+  return "item/" + std::to_string(i);
+}
+
+std::string itemTitle(unsigned i)
+{
+  return "Title " + std::to_string(i);
+}
+
+std::string itemContent(unsigned i)
+{
+  std::ostringstream ss;
+  ss << "<html><body>Item " << i << " ";
+  for (unsigned k=0; k<(i*7919)%500; k++) {
+    ss << char('a' + (i+k)%26);
+  }
+  ss << "</body></html>";
+  return ss.str();
+}
+
+// Add `nbItems` items and a redirection for every tenth of them.
+// A metadata is always added, so the archive has entries out of the 'C'
+// namespace.
+void addItems(zim::writer::Creator& creator, unsigned nbItems)
+{
+  for (unsigned i=0; i<nbItems; i++) {
+    creator.addItem(zim::writer::StringItem::create(itemPath(i), "text/html", itemTitle(i), itemContent(i)));
+    if (i%10 == 0) {
+      creator.addRedirection("redirect/" + std::to_string(i), "Redirect " + std::to_string(i), itemPath(i));
+    }
+  }
+  creator.addMetadata("Title", "Test archive");
+}
+
+// Check that the archive contains the entries added by `addItems`.
+void checkItems(const std::string& path, unsigned nbItems)
+{
+  zim::IntegrityCheckList checks;
+  checks.set();
+  ASSERT_TRUE(zim::validate(path, checks));
+
+  zim::Archive archive(path);
+  ASSERT_EQ(archive.getEntryCount(), nbItems + (nbItems+9)/10);
+  for (unsigned i=0; i<nbItems; i++) {
+    auto entry = archive.getEntryByPath(itemPath(i));
+    ASSERT_EQ(entry.getTitle(), itemTitle(i));
+    ASSERT_EQ(std::string(entry.getItem().getData()), itemContent(i)) << "i: " << i;
+    if (i%10 == 0) {
+      auto redirect = archive.getEntryByPath("redirect/" + std::to_string(i));
+      ASSERT_TRUE(redirect.isRedirect());
+      ASSERT_EQ(redirect.getRedirectEntry().getPath(), itemPath(i));
+    }
+  }
+  ASSERT_EQ(archive.getMetadata("Title"), "Test archive");
+}
+
+TEST(ZimCreator, direntsWrittenByChunks)
+{
+  // More dirents than several chunks (of 16K dirents) serialized at the
+  // same time by the workers.
+  const unsigned nbItems = 50000;
+  TempZimFile zimFile("creator_chunks");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1).configNbWorkers(2);
+    creator.startZimCreation(zimFile.path());
+    addItems(creator, nbItems);
+    creator.finishZimCreation();
+  }
+  checkItems(zimFile.path(), nbItems);
+
+  // Entries in title order.
+  zim::Archive archive(zimFile.path());
+  std::string previousTitle;
+  unsigned count = 0;
+  for (auto& entry: archive.iterByTitle()) {
+    ASSERT_LE(previousTitle, entry.getTitle());
+    previousTitle = entry.getTitle();
+    count++;
+  }
+  ASSERT_EQ(count, archive.getEntryCount());
+}
+
+TEST(ZimCreator, externalDirentsWrittenByChunks)
+{
+  const unsigned nbItems = 50000;
+  TempZimFile zimFile("creator_external_chunks");
+  {
+    zim::writer::Creator creator;
+    // A small memory budget, to sort the dirents in several runs.
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1).configNbWorkers(2)
+           .configExternalDirentSort(1024*1024);
+    creator.startZimCreation(zimFile.path());
+    addItems(creator, nbItems);
+    creator.finishZimCreation();
+  }
+  checkItems(zimFile.path(), nbItems);
+}
+
+// Add the entries of `addItems` from `nbThreads` threads at once.
+void addItemsConcurrently(zim::writer::Creator& creator, unsigned nbItems, unsigned nbThreads)
+{
+  std::vector<std::thread> threads;
+  for (unsigned t=0; t<nbThreads; t++) {
+    threads.emplace_back([&creator, nbItems, nbThreads, t]() {
+      for (unsigned i=t; i<nbItems; i+=nbThreads) {
+        creator.addItem(zim::writer::StringItem::create(itemPath(i), "text/html", itemTitle(i), itemContent(i)));
+        if (i%10 == 0) {
+          creator.addRedirection("redirect/" + std::to_string(i), "Redirect " + std::to_string(i), itemPath(i));
+        }
+      }
+    });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+  creator.addMetadata("Title", "Test archive");
+}
+
+TEST(ZimCreator, concurrentProducers)
+{
+  // Small clusters (and a full cluster queue) so the threads often close
+  // clusters at the same time.
+  const unsigned nbItems = 5000;
+  for (auto externalSort: {zim::size_type(0), zim::size_type(1024*1024)}) {
+    TempZimFile zimFile("creator_concurrent");
+    {
+      zim::writer::Creator creator;
+      creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+             .configMinClusterSize(4).configNbWorkers(2)
+             .configExternalDirentSort(externalSort);
+      creator.startZimCreation(zimFile.path());
+      addItemsConcurrently(creator, nbItems, 4);
+      creator.finishZimCreation();
+    }
+    checkItems(zimFile.path(), nbItems);
+  }
+}
+
+// The paths of the 'C' entries in the order of their content in the
+// archive (by cluster and by blob).
+std::vector<std::string> pathsInContentOrder(const std::string& path, const std::vector<std::string>& paths)
+{
+  zim::Archive archive(path);
+  std::vector<std::tuple<zim::cluster_index_type, zim::blob_index_type, std::string>> blobs;
+  for (const auto& p: paths) {
+    const auto dirent = archive.getImpl()->getDirent(zim::entry_index_t(archive.getEntryByPath(p).getIndex()));
+    blobs.emplace_back(dirent->getClusterNumber().v, dirent->getBlobNumber().v, p);
+  }
+  std::sort(blobs.begin(), blobs.end());
+  std::vector<std::string> orderedPaths;
+  for (const auto& blob: blobs) {
+    orderedPaths.push_back(std::get<2>(blob));
+  }
+  return orderedPaths;
+}
+
+// Create an archive of items of two directories and two mimetypes, added
+// interleaved, and return the paths of the items in the order of their
+// content.
+std::vector<std::string> createInterleavedItems(const std::string& path, zim::size_type clusteringWindow,
+                                                std::vector<std::string>& paths)
+{
+  const unsigned nbItems = 200;
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+           .configClusteringWindow(clusteringWindow);
+    creator.startZimCreation(path);
+    for (unsigned i=0; i<nbItems; i++) {
+      std::ostringstream ss;
+      ss << (i%2 ? "dirB/" : "dirA/") << std::setw(3) << std::setfill('0') << i;
+      paths.push_back(ss.str());
+      const char* mimetype = i%3 ? "text/html" : "text/css";
+      creator.addItem(zim::writer::StringItem::create(ss.str(), mimetype, itemTitle(i), itemContent(i)));
+    }
+    creator.addMetadata("Title", "Test archive");
+    creator.finishZimCreation();
+  }
+  return pathsInContentOrder(path, paths);
+}
+
+TEST(ZimCreator, noClusteringWindow)
+{
+  TempZimFile zimFile("creator_no_clustering_window");
+  std::vector<std::string> paths;
+  const auto orderedPaths = createInterleavedItems(zimFile.path(), 0, paths);
+  // Items are stored in the order they are added.
+  ASSERT_EQ(orderedPaths, paths);
+}
+
+TEST(ZimCreator, clusteringWindow)
+{
+  TempZimFile zimFile("creator_clustering_window");
+  std::vector<std::string> paths;
+  const auto orderedPaths = createInterleavedItems(zimFile.path(), 100, paths);
+  ASSERT_EQ(orderedPaths.size(), paths.size());
+
+  // Each window of 100 items is grouped by mimetype (in the order of their
+  // first use) and by path.
+  for (unsigned window=0; window<2; window++) {
+    std::vector<std::string> expected;
+    for (const char* mimetype: {"text/css", "text/html"}) {
+      std::vector<std::string> group;
+      for (unsigned i=window*100; i<(window+1)*100; i++) {
+        if ((i%3 ? "text/html" : "text/css") == std::string(mimetype)) {
+          group.push_back(paths[i]);
+        }
+      }
+      std::sort(group.begin(), group.end());
+      expected.insert(expected.end(), group.begin(), group.end());
+    }
+    ASSERT_EQ(std::vector<std::string>(orderedPaths.begin() + window*100, orderedPaths.begin() + (window+1)*100),
+              expected) << "window " << window;
+  }
+
+  zim::Archive archive(zimFile.path());
+  for (unsigned i=0; i<paths.size(); i++) {
+    ASSERT_EQ(std::string(archive.getEntryByPath(paths[i]).getItem().getData()), itemContent(i));
+  }
+}
+
+// A provider of a content fed by chunks of 1000 bytes.
+class ChunkedProvider : public zim::writer::ContentProvider
+{
+  public:
+    explicit ChunkedProvider(const std::string& content)
+      : m_content(content)
+    {}
+
+    zim::size_type getSize() const { return m_content.size(); }
+
+    zim::Blob feed()
+    {
+      const auto size = std::min<size_t>(1000, m_content.size() - m_offset);
+      zim::Blob blob(m_content.data() + m_offset, size);
+      m_offset += size;
+      return blob;
+    }
+
+  private:
+    std::string m_content;
+    size_t m_offset = 0;
+};
+
+class ChunkedItem : public zim::writer::BasicItem
+{
+  public:
+    ChunkedItem(const std::string& path, const std::string& content, const std::string& mimetype = "text/html")
+      : BasicItem(path, mimetype, ""),
+        m_content(content)
+    {}
+
+    std::unique_ptr<zim::writer::ContentProvider> getContentProvider() const
+    {
+      return std::unique_ptr<zim::writer::ContentProvider>(new ChunkedProvider(m_content));
+    }
+
+  private:
+    std::string m_content;
+};
+
+void writeFile(const std::string& path, const std::string& content)
+{
+  std::ofstream out(path, std::ios::binary);
+  out << content;
+}
+
+// The cluster and blob numbers of the content of an item.
+std::pair<zim::cluster_index_type, zim::blob_index_type> blobOf(const zim::Archive& archive, const std::string& path)
+{
+  const auto dirent = archive.getImpl()->getDirent(zim::entry_index_t(archive.getEntryByPath(path).getIndex()));
+  return std::make_pair(dirent->getClusterNumber().v, dirent->getBlobNumber().v);
+}
+
+std::string itemData(const zim::Archive& archive, const std::string& path)
+{
+  return std::string(archive.getEntryByPath(path).getItem().getData());
+}
+
+TEST(ZimCreator, deduplicationHits)
+{
+  const std::string content = itemContent(499);
+  // A file too big to be read in memory to be hashed.
+  std::string bigContent(17*1024*1024, 'x');
+  for (size_t i=0; i<bigContent.size(); i+=4096) {
+    bigContent[i] = char(i/4096);
+  }
+  TempFile file1("dedup_file1"), file2("dedup_file2");
+  writeFile(file1.path(), bigContent);
+  writeFile(file2.path(), bigContent);
+
+  TempZimFile zimFile("creator_dedup_hits");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1).configDeduplication(true);
+    creator.startZimCreation(zimFile.path());
+    creator.addItem(zim::writer::StringItem::create("string1", "text/html", "", content));
+    creator.addItem(zim::writer::StringItem::create("string2", "text/html", "", content));
+    creator.addItem(std::make_shared<ChunkedItem>("chunked", content));
+    creator.addItem(std::make_shared<zim::writer::FileItem>("file1", "image/png", "", file1.path()));
+    creator.addItem(std::make_shared<zim::writer::FileItem>("file2", "image/png", "", file2.path()));
+    creator.addMetadata("Title", "Test archive");
+    creator.finishZimCreation();
+  }
+
+  zim::Archive archive(zimFile.path());
+  // Whatever their provider, items with the same content share their data.
+  ASSERT_EQ(blobOf(archive, "string1"), blobOf(archive, "string2"));
+  ASSERT_EQ(blobOf(archive, "string1"), blobOf(archive, "chunked"));
+  ASSERT_EQ(blobOf(archive, "file1"), blobOf(archive, "file2"));
+  ASSERT_NE(blobOf(archive, "string1"), blobOf(archive, "file1"));
+  for (const char* path: {"string1", "string2", "chunked"}) {
+    ASSERT_EQ(itemData(archive, path), content) << path;
+  }
+  ASSERT_EQ(itemData(archive, "file1"), bigContent);
+  ASSERT_EQ(itemData(archive, "file2"), bigContent);
+}
+
+TEST(ZimCreator, deduplicationMisses)
+{
+  const std::string content = itemContent(499);
+  std::string otherContent = content;
+  otherContent[10] = 'X';
+
+  TempZimFile zimFile("creator_dedup_misses");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1).configDeduplication(true);
+    creator.startZimCreation(zimFile.path());
+    creator.addItem(zim::writer::StringItem::create("item", "text/html", "", content));
+    // Same size, different content.
+    creator.addItem(zim::writer::StringItem::create("other", "text/html", "", otherContent));
+    creator.addItem(std::make_shared<ChunkedItem>("chunked", otherContent));
+    creator.addMetadata("Title", "Test archive");
+    creator.finishZimCreation();
+  }
+
+  zim::Archive archive(zimFile.path());
+  ASSERT_NE(blobOf(archive, "item"), blobOf(archive, "other"));
+  ASSERT_EQ(blobOf(archive, "other"), blobOf(archive, "chunked"));
+  ASSERT_EQ(itemData(archive, "item"), content);
+  ASSERT_EQ(itemData(archive, "other"), otherContent);
+  ASSERT_EQ(itemData(archive, "chunked"), otherContent);
+}
+
+std::string fromHex(const std::string& hex)
+{
+  std::string bytes;
+  for (size_t i=0; i<hex.size(); i+=2) {
+    bytes.push_back(char(std::stoi(hex.substr(i, 2), nullptr, 16)));
+  }
+  return bytes;
+}
+
+TEST(ZimCreator, deduplicationCollisions)
+{
+  // Two different contents of the same size with the same MD5.
+  const std::string content1 = fromHex(
+    "d131dd02c5e6eec4693d9a0698aff95c2fcab58712467eab4004583eb8fb7f89"
+    "55ad340609f4b30283e488832571415a085125e8f7cdc99fd91dbdf280373c5b"
+    "d8823e3156348f5bae6dacd436c919c6dd53e2b487da03fd02396306d248cda0"
+    "e99f33420f577ee8ce54b67080a80d1ec69821bcb6a8839396f9652b6ff72a70");
+  const std::string content2 = fromHex(
+    "d131dd02c5e6eec4693d9a0698aff95c2fcab50712467eab4004583eb8fb7f89"
+    "55ad340609f4b30283e4888325f1415a085125e8f7cdc99fd91dbd7280373c5b"
+    "d8823e3156348f5bae6dacd436c919c6dd53e23487da03fd02396306d248cda0"
+    "e99f33420f577ee8ce54b67080280d1ec69821bcb6a8839396f965ab6ff72a70");
+  ASSERT_NE(content1, content2);
+
+  TempZimFile zimFile("creator_dedup_collisions");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1).configDeduplication(true);
+    creator.startZimCreation(zimFile.path());
+    creator.addItem(zim::writer::StringItem::create("content1", "application/octet-stream", "", content1));
+    creator.addItem(zim::writer::StringItem::create("content2", "application/octet-stream", "", content2));
+    creator.addMetadata("Title", "Test archive");
+    creator.finishZimCreation();
+  }
+
+  zim::Archive archive(zimFile.path());
+  ASSERT_NE(blobOf(archive, "content1"), blobOf(archive, "content2"));
+  ASSERT_EQ(itemData(archive, "content1"), content1);
+  ASSERT_EQ(itemData(archive, "content2"), content2);
+}
+
+// Whether the content of an item is in a compressed cluster.
+bool inCompressedCluster(const zim::Archive& archive, const std::string& path)
+{
+  return archive.getImpl()->getCluster(zim::cluster_index_t(blobOf(archive, path).first))->isCompressed();
+}
+
+TEST(ZimCreator, compressionDetection)
+{
+  // Random bytes, like already compressed data.
+  std::string compressedContent(20000, '\0');
+  uint32_t value = 1;
+  for (auto& c: compressedContent) {
+    value = value * 1103515245 + 12345;
+    c = char(value >> 24);
+  }
+  std::string textContent;
+  for (unsigned i=0; textContent.size() < 20000; i++) {
+    textContent += itemContent(i);
+  }
+  TempFile compressedFile("creator_detection_compressed");
+  writeFile(compressedFile.path(), compressedContent);
+  TempFile textFile("creator_detection_text");
+  writeFile(textFile.path(), textContent);
+
+  for (bool detect: {false, true}) {
+    TempZimFile zimFile("creator_detection");
+    {
+      zim::writer::Creator creator;
+      creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+             .configCompressionDetection(detect);
+      creator.startZimCreation(zimFile.path());
+      // Compressed according to their mimetype.
+      creator.addItem(zim::writer::StringItem::create("string/compressed", "text/html", "", compressedContent));
+      creator.addItem(std::make_shared<zim::writer::FileItem>("file/compressed", "text/html", "", compressedFile.path()));
+      creator.addItem(std::make_shared<ChunkedItem>("custom/compressed", compressedContent));
+      // Not compressed according to their mimetype.
+      creator.addItem(zim::writer::StringItem::create("string/text", "application/octet-stream", "", textContent));
+      creator.addItem(std::make_shared<zim::writer::FileItem>("file/text", "application/octet-stream", "", textFile.path()));
+      creator.addItem(std::make_shared<ChunkedItem>("custom/text", textContent, "application/octet-stream"));
+      creator.addMetadata("Title", "Test archive");
+      creator.finishZimCreation();
+    }
+
+    zim::Archive archive(zimFile.path());
+    for (auto provider: {"string", "file", "custom"}) {
+      const std::string prefix(provider);
+      ASSERT_EQ(inCompressedCluster(archive, prefix + "/compressed"), !detect) << prefix;
+      ASSERT_EQ(inCompressedCluster(archive, prefix + "/text"), detect) << prefix;
+      ASSERT_EQ(itemData(archive, prefix + "/compressed"), compressedContent) << prefix;
+      ASSERT_EQ(itemData(archive, prefix + "/text"), textContent) << prefix;
+    }
+  }
+}
+
+TEST(ZimCreator, streamedItems)
+{
+  const unsigned nbItems = 100;
+  std::string bigContent;
+  for (unsigned i=0; bigContent.size() < 200*1024; i++) {
+    bigContent += itemContent(i);
+  }
+  // The streamed clusters are compressed in temporary files, seekable
+  // ones with their frame index in front of the frames.
+  for (auto frameSize: {zim::size_type(0), zim::size_type(16*1024)}) {
+    TempZimFile zimFile("creator_streamed");
+    {
+      zim::writer::Creator creator;
+      creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+             .configClusterFrameSize(frameSize)
+             .configStreamedItemSize(100*1024);
+      creator.startZimCreation(zimFile.path());
+      creator.addItem(zim::writer::StringItem::create("big/compressed", "text/html", "", bigContent));
+      creator.addItem(zim::writer::StringItem::create("big/uncompressed", "image/png", "", bigContent));
+      addItems(creator, nbItems);
+      creator.finishZimCreation();
+    }
+    // The temporary file is removed once copied.
+    ASSERT_FALSE(std::ifstream(zimFile.path() + ".stream0.tmp").good());
+
+    zim::IntegrityCheckList checks;
+    checks.set();
+    ASSERT_TRUE(zim::validate(zimFile.path(), checks));
+    zim::Archive archive(zimFile.path());
+    for (auto path: {"big/compressed", "big/uncompressed"}) {
+      // Alone in its cluster.
+      const auto cluster = archive.getImpl()->getCluster(zim::cluster_index_t(blobOf(archive, path).first));
+      ASSERT_EQ(cluster->count().v, 1U) << path;
+      ASSERT_EQ(cluster->isCompressed(), std::string(path) == "big/compressed");
+      ASSERT_EQ(itemData(archive, path), bigContent) << path;
+    }
+    for (unsigned i=0; i<nbItems; i++) {
+      ASSERT_EQ(itemData(archive, itemPath(i)), itemContent(i)) << "i: " << i;
+    }
+  }
+}
+
+// A provider blocking its first `feed` until the gate is opened, so the
+// cluster containing it stays pending.
+class Gate
+{
+  public:
+    void open()
+    {
+      {
+        std::lock_guard<std::mutex> l(m_mutex);
+        m_open = true;
+      }
+      m_cond.notify_all();
+    }
+
+    void wait()
+    {
+      std::unique_lock<std::mutex> l(m_mutex);
+      m_cond.wait(l, [this]{ return m_open; });
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_open = false;
+};
+
+class GatedProvider : public zim::writer::ContentProvider
+{
+  public:
+    GatedProvider(const std::string& content, Gate& gate)
+      : m_content(content),
+        m_gate(gate)
+    {}
+
+    zim::size_type getSize() const { return m_content.size(); }
+
+    zim::Blob feed()
+    {
+      m_gate.wait();
+      if (m_fed) {
+        return zim::Blob();
+      }
+      m_fed = true;
+      return zim::Blob(m_content.data(), m_content.size());
+    }
+
+  private:
+    std::string m_content;
+    Gate& m_gate;
+    bool m_fed = false;
+};
+
+class GatedItem : public zim::writer::BasicItem
+{
+  public:
+    GatedItem(const std::string& path, const std::string& content, Gate& gate)
+      : BasicItem(path, "text/html", ""),
+        m_content(content),
+        m_gate(gate)
+    {}
+
+    std::unique_ptr<zim::writer::ContentProvider> getContentProvider() const
+    {
+      return std::unique_ptr<zim::writer::ContentProvider>(new GatedProvider(m_content, m_gate));
+    }
+
+  private:
+    std::string m_content;
+    Gate& m_gate;
+};
+
+TEST(ZimCreator, clusterMemoryBudget)
+{
+  // Clusters of 1KB, each item fills one. The first cluster can't be
+  // compressed until the gate is opened: once it is pending, closing
+  // another cluster exceeds the budget and addItem blocks.
+  const std::string content(2000, 'a');
+  Gate gate;
+  TempZimFile zimFile("creator_memory_budget");
+  zim::writer::Creator creator;
+  creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+         .configMinClusterSize(1).configClusterMemoryBudget(1).configNbWorkers(1);
+  creator.startZimCreation(zimFile.path());
+
+  std::atomic<unsigned> nbAdded(0);
+  std::thread producer([&]() {
+    creator.addItem(std::make_shared<GatedItem>(itemPath(0), content, gate));
+    nbAdded++;
+    for (unsigned i=1; i<4; i++) {
+      creator.addItem(zim::writer::StringItem::create(itemPath(i), "text/html", itemTitle(i), content));
+      nbAdded++;
+    }
+  });
+
+  // Adding item 1 closes the gated cluster, adding item 2 closes the
+  // cluster of item 1 and waits for the gated one: once the second cluster
+  // is counted, the producer can't return from addItem before the gate is
+  // opened.
+  while (creator.getProgress().closedClusterCount < 2) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // (EXPECT: the producer must be joined whatever the result.)
+  EXPECT_EQ(creator.getProgress().closedClusterCount, 2U);
+  EXPECT_EQ(nbAdded, 2U);
+  EXPECT_GE(creator.getProgress().pendingClusterMemory, content.size());
+
+  gate.open();
+  producer.join();
+  ASSERT_EQ(nbAdded, 4U);
+  creator.addMetadata("Title", "Test archive");
+  creator.finishZimCreation();
+
+  zim::Archive archive(zimFile.path());
+  for (unsigned i=0; i<4; i++) {
+    ASSERT_EQ(itemData(archive, itemPath(i)), content) << "i: " << i;
+  }
+}
+
+std::string readFile(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+TEST(ZimCreator, reproducibleByDefault)
+{
+  // Without a reorder window, the clusters are written in the order they
+  // are closed whatever the scheduling of the workers: the same input
+  // (and uuid) gives the same file.
+  const unsigned nbItems = 2000;
+  const char uuid[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+  std::string contents[2];
+  for (auto& content: contents) {
+    TempZimFile zimFile("creator_reproducible");
+    {
+      zim::writer::Creator creator;
+      creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+             .configMinClusterSize(4).configNbWorkers(4);
+      creator.setUuid(zim::Uuid(uuid));
+      creator.startZimCreation(zimFile.path());
+      addItems(creator, nbItems);
+      creator.finishZimCreation();
+    }
+    checkItems(zimFile.path(), nbItems);
+    content = readFile(zimFile.path());
+  }
+  ASSERT_FALSE(contents[0].empty());
+  ASSERT_TRUE(contents[0] == contents[1]);
+}
+
+TEST(ZimCreator, progress)
+{
+  const unsigned nbItems = 1000;
+  const std::string image(100, 'x');
+  TempZimFile zimFile("creator_progress");
+  zim::writer::Creator creator;
+  creator.configCompression(zim::zimcompZstd).configCompressionLevel(1).configMinClusterSize(4);
+
+  auto progress = creator.getProgress();
+  ASSERT_EQ(progress.itemCount, 0U);
+  ASSERT_EQ(progress.writtenSize, 0U);
+
+  creator.startZimCreation(zimFile.path());
+  addItems(creator, nbItems);
+  // In an uncompressed cluster.
+  creator.addItem(zim::writer::StringItem::create("image", "image/png", "", image));
+  creator.finishZimCreation();
+
+  zim::size_type inputSize = image.size() + std::string("Test archive").size();
+  for (unsigned i=0; i<nbItems; i++) {
+    inputSize += itemContent(i).size();
+  }
+  zim::Archive archive(zimFile.path());
+
+  progress = creator.getProgress();
+  ASSERT_GT(progress.elapsedTime, 0);
+  // The items, the "Title" metadata and the image.
+  ASSERT_EQ(progress.itemCount, nbItems + 2);
+  ASSERT_EQ(progress.redirectCount, nbItems/10);
+  ASSERT_EQ(progress.indexedItemCount, 0U);
+
+  ASSERT_EQ(progress.closedClusterCount, archive.getClusterCount());
+  ASSERT_EQ(progress.compressedClusterCount, progress.closedClusterCount - 1);
+  ASSERT_EQ(progress.writtenClusterCount, progress.closedClusterCount);
+
+  ASSERT_EQ(progress.inputSize, inputSize);
+  // The compressed content also contains the entries added by the creator
+  // (title listing...).
+  ASSERT_GE(progress.compressedInputSize, inputSize - image.size());
+  ASSERT_LT(progress.compressedOutputSize, progress.compressedInputSize);
+  ASSERT_GT(progress.writtenSize, progress.compressedOutputSize);
+  ASSERT_LT(progress.writtenSize, archive.getFilesize());
+
+  ASSERT_EQ(progress.taskQueueSize, 0U);
+  ASSERT_EQ(progress.clusterQueueSize, 0U);
+  ASSERT_EQ(progress.pendingClusterMemory, 0U);
+
+  // Nothing added since the previous call.
+  progress = creator.getProgress();
+  ASSERT_EQ(progress.inputMBps, 0);
+  ASSERT_EQ(progress.writtenMBps, 0);
+}
+
+// What happened to the providers of the items added with `addItems`.
+struct FetchLog
+{
+  std::mutex mutex;
+  std::vector<unsigned> prefetched;           // Items in prefetch order.
+  std::map<unsigned, std::thread::id> fetchThreads;  // getContentProvider
+  std::map<unsigned, std::thread::id> feedThreads;   // First feed.
+};
+
+class PrefetchedProvider : public zim::writer::ContentProvider, public zim::writer::PrefetchableProvider
+{
+  public:
+    PrefetchedProvider(unsigned i, bool ready, bool failing, FetchLog& log)
+      : m_i(i), m_ready(ready), m_failing(failing), m_log(log), m_content(itemContent(i))
+    {}
+
+    zim::size_type getSize() const { return m_content.size(); }
+
+    zim::Blob feed()
+    {
+      if (m_fed) {
+        return zim::Blob();
+      }
+      m_fed = true;
+      std::lock_guard<std::mutex> l(m_log.mutex);
+      m_log.feedThreads[m_i] = std::this_thread::get_id();
+      return zim::Blob(m_content.data(), m_content.size());
+    }
+
+    void prefetch()
+    {
+      if (m_failing) {
+        throw std::runtime_error("prefetch " + std::to_string(m_i));
+      }
+      std::lock_guard<std::mutex> l(m_log.mutex);
+      m_log.prefetched.push_back(m_i);
+    }
+
+    bool ready() const { return m_ready; }
+
+  private:
+    unsigned m_i;
+    bool m_ready;
+    bool m_failing;
+    FetchLog& m_log;
+    std::string m_content;
+    bool m_fed = false;
+};
+
+class PrefetchedItem : public zim::writer::BasicItem
+{
+  public:
+    enum Failure { NONE, GET_PROVIDER, PREFETCH };
+
+    PrefetchedItem(unsigned i, bool ready, FetchLog& log, Failure failure = NONE)
+      : BasicItem(itemPath(i), "text/html", itemTitle(i)),
+        m_i(i), m_ready(ready), m_log(log), m_failure(failure)
+    {}
+
+    std::unique_ptr<zim::writer::ContentProvider> getContentProvider() const
+    {
+      if (m_failure == GET_PROVIDER) {
+        throw std::runtime_error("getContentProvider " + std::to_string(m_i));
+      }
+      {
+        std::lock_guard<std::mutex> l(m_log.mutex);
+        m_log.fetchThreads[m_i] = std::this_thread::get_id();
+      }
+      return std::unique_ptr<zim::writer::ContentProvider>(
+        new PrefetchedProvider(m_i, m_ready, m_failure == PREFETCH, m_log));
+    }
+
+  private:
+    unsigned m_i;
+    bool m_ready;
+    FetchLog& m_log;
+    Failure m_failure;
+};
+
+std::vector<std::string> itemPaths(unsigned nbItems)
+{
+  std::vector<std::string> paths;
+  for (unsigned i=0; i<nbItems; i++) {
+    paths.push_back(itemPath(i));
+  }
+  return paths;
+}
+
+TEST(ZimCreator, addItemsPrefetchOrder)
+{
+  const unsigned nbItems = 200;
+  for (unsigned nbFetchers: {1, 4}) {
+    FetchLog log;
+    TempZimFile zimFile("creator_add_items");
+    {
+      zim::writer::Creator creator;
+      creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+             .configFetchConcurrency(nbFetchers);
+      creator.startZimCreation(zimFile.path());
+      std::vector<std::shared_ptr<zim::writer::Item>> items;
+      for (unsigned i=0; i<nbItems; i++) {
+        items.push_back(std::make_shared<PrefetchedItem>(i, true, log));
+      }
+      creator.addItems(items);
+      creator.addMetadata("Title", "Test archive");
+      creator.finishZimCreation();
+    }
+
+    // Each item is prefetched once, in order with a single fetcher.
+    auto prefetched = log.prefetched;
+    if (nbFetchers > 1) {
+      std::sort(prefetched.begin(), prefetched.end());
+    }
+    ASSERT_EQ(prefetched.size(), nbItems);
+    for (unsigned i=0; i<nbItems; i++) {
+      ASSERT_EQ(prefetched[i], i) << "nbFetchers: " << nbFetchers;
+    }
+    // Whatever the order of the fetch, items are added in order.
+    const auto paths = itemPaths(nbItems);
+    ASSERT_EQ(pathsInContentOrder(zimFile.path(), paths), paths);
+    zim::Archive archive(zimFile.path());
+    for (unsigned i=0; i<nbItems; i++) {
+      ASSERT_EQ(itemData(archive, itemPath(i)), itemContent(i));
+    }
+  }
+}
+
+TEST(ZimCreator, addItemsReadyProviders)
+{
+  // The providers not ready after prefetch are read by the fetch thread,
+  // the ready ones are fed when their cluster is compressed.
+  const unsigned nbItems = 100;
+  FetchLog log;
+  TempZimFile zimFile("creator_add_items_ready");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+           .configFetchConcurrency(2);
+    creator.startZimCreation(zimFile.path());
+    std::vector<std::shared_ptr<zim::writer::Item>> items;
+    for (unsigned i=0; i<nbItems; i++) {
+      items.push_back(std::make_shared<PrefetchedItem>(i, i%2 == 0, log));
+    }
+    creator.addItems(items);
+    creator.addMetadata("Title", "Test archive");
+    creator.finishZimCreation();
+  }
+
+  ASSERT_EQ(log.feedThreads.size(), nbItems);
+  for (unsigned i=0; i<nbItems; i++) {
+    const bool ready = i%2 == 0;
+    ASSERT_NE(log.fetchThreads[i], std::this_thread::get_id());
+    ASSERT_EQ(log.feedThreads[i] == log.fetchThreads[i], !ready) << "i: " << i;
+  }
+  zim::Archive archive(zimFile.path());
+  for (unsigned i=0; i<nbItems; i++) {
+    ASSERT_EQ(itemData(archive, itemPath(i)), itemContent(i));
+  }
+}
+
+TEST(ZimCreator, addItemsErrors)
+{
+  // The error of an item is thrown when the item would have been added:
+  // the items before it are added.
+  const unsigned nbItems = 50;
+  const unsigned failingItem = 20;
+  for (auto failure: {PrefetchedItem::GET_PROVIDER, PrefetchedItem::PREFETCH}) {
+    FetchLog log;
+    TempZimFile zimFile("creator_add_items_errors");
+    {
+      zim::writer::Creator creator;
+      creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+             .configFetchConcurrency(4);
+      creator.startZimCreation(zimFile.path());
+      std::vector<std::shared_ptr<zim::writer::Item>> items;
+      for (unsigned i=0; i<nbItems; i++) {
+        items.push_back(std::make_shared<PrefetchedItem>(i, false, log,
+                          i == failingItem ? failure : PrefetchedItem::NONE));
+      }
+      try {
+        creator.addItems(items);
+        FAIL() << "No exception thrown";
+      } catch (const std::runtime_error& e) {
+        const std::string expected = failure == PrefetchedItem::GET_PROVIDER
+                                   ? "getContentProvider 20" : "prefetch 20";
+        ASSERT_EQ(std::string(e.what()), expected);
+      }
+      creator.addMetadata("Title", "Test archive");
+      creator.finishZimCreation();
+    }
+
+    zim::Archive archive(zimFile.path());
+    for (unsigned i=0; i<failingItem; i++) {
+      ASSERT_EQ(itemData(archive, itemPath(i)), itemContent(i));
+    }
+    for (unsigned i=failingItem; i<nbItems; i++) {
+      ASSERT_THROW(archive.getEntryByPath(itemPath(i)), zim::EntryNotFound);
+    }
+  }
+}
+
+TEST(ZimCreator, updateArchive)
+{
+  const unsigned nbItems = 1000;
+  TempZimFile zimFile("creator_update_source");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1);
+    creator.startZimCreation(zimFile.path());
+    addItems(creator, nbItems);
+    creator.finishZimCreation();
+  }
+
+  TempZimFile updatedFile("creator_update");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1);
+    creator.startZimUpdate(updatedFile.path(), zimFile.path());
+    // Replaced
+    creator.addItem(zim::writer::StringItem::create(itemPath(1), "text/html", "New title 1", "new content 1"));
+    // Added
+    creator.addItem(zim::writer::StringItem::create("new/0", "text/html", "New item", "new content"));
+    // Removed
+    creator.removeEntry(itemPath(2));
+    // Removed with the redirection to it
+    creator.removeEntry(itemPath(10));
+    // Removed and added again: the redirection to it is kept
+    creator.removeEntry(itemPath(20));
+    creator.addItem(zim::writer::StringItem::create(itemPath(20), "text/html", "New title 20", "new content 20"));
+    creator.finishZimCreation();
+  }
+
+  zim::IntegrityCheckList checks;
+  checks.set();
+  ASSERT_TRUE(zim::validate(updatedFile.path(), checks));
+
+  zim::Archive archive(updatedFile.path());
+  ASSERT_EQ(archive.getEntryCount(), nbItems + nbItems/10 - 3 + 1);
+  ASSERT_THROW(archive.getEntryByPath(itemPath(2)), zim::EntryNotFound);
+  ASSERT_THROW(archive.getEntryByPath(itemPath(10)), zim::EntryNotFound);
+  ASSERT_THROW(archive.getEntryByPath("redirect/10"), zim::EntryNotFound);
+  ASSERT_EQ(archive.getEntryByPath(itemPath(1)).getTitle(), "New title 1");
+  ASSERT_EQ(itemData(archive, itemPath(1)), "new content 1");
+  ASSERT_EQ(itemData(archive, "new/0"), "new content");
+  ASSERT_EQ(itemData(archive, itemPath(20)), "new content 20");
+  ASSERT_EQ(archive.getEntryByPath("redirect/20").getRedirectEntry().getPath(), itemPath(20));
+  for (unsigned i=0; i<nbItems; i++) {
+    if (i == 1 || i == 2 || i == 10 || i == 20) {
+      continue;
+    }
+    auto entry = archive.getEntryByPath(itemPath(i));
+    ASSERT_EQ(entry.getTitle(), itemTitle(i));
+    ASSERT_EQ(std::string(entry.getItem().getData()), itemContent(i)) << "i: " << i;
+    if (i%10 == 0) {
+      ASSERT_EQ(archive.getEntryByPath("redirect/" + std::to_string(i)).getRedirectEntry().getPath(), itemPath(i));
+    }
+  }
+  ASSERT_EQ(archive.getMetadata("Title"), "Test archive");
+}
+
+TEST(ZimCreator, updateOldNamespaceScheme)
+{
+  // small.zim uses the 'A', 'I'... namespaces.
+  TempZimFile zimFile("creator_update_old_scheme");
+  zim::writer::Creator creator;
+  ASSERT_THROW(creator.startZimUpdate(zimFile.path(), "./data/small.zim"), std::runtime_error);
+}
+
+TEST(ZimCreator, removeEntryWithoutUpdate)
+{
+  TempZimFile zimFile("creator_remove_entry");
+  zim::writer::Creator creator;
+  creator.startZimCreation(zimFile.path());
+  ASSERT_THROW(creator.removeEntry(itemPath(0)), std::runtime_error);
+  creator.addMetadata("Title", "Test archive");
+  creator.finishZimCreation();
+}
+
+#if defined(LIBZIM_WITH_XAPIAN)
+// The paths of the suggestions for `query`.
+std::vector<std::string> suggestions(const zim::Archive& archive, const std::string& query)
+{
+  zim::Search search(archive);
+  search.set_suggestion_mode(true).set_query(query).set_range(0, 10);
+  std::vector<std::string> paths;
+  for (auto it = search.begin(); it != search.end(); ++it) {
+    paths.push_back(it.get_url());
+  }
+  return paths;
+}
+
+TEST(ZimCreator, titlesIndexedByTheirThread)
+{
+  // Titles are sent to the title indexer thread by batches of 1024: the
+  // last batch is not full.
+  const unsigned nbItems = 3000;
+  TempZimFile zimFile("creator_title_index");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1).configNbWorkers(2);
+    creator.startZimCreation(zimFile.path());
+    addItems(creator, nbItems);
+    creator.finishZimCreation();
+  }
+  checkItems(zimFile.path(), nbItems);
+
+  zim::Archive archive(zimFile.path());
+  for (unsigned i: {0U, 1023U, 1024U, 2500U, nbItems-1}) {
+    const auto paths = suggestions(archive, itemTitle(i));
+    ASSERT_NE(std::find(paths.begin(), paths.end(), itemPath(i)), paths.end()) << itemTitle(i);
+  }
+  // Redirections are indexed too.
+  const auto paths = suggestions(archive, "Redirect 2990");
+  ASSERT_NE(std::find(paths.begin(), paths.end(), "redirect/2990"), paths.end());
+}
+
+TEST(ZimCreator, fulltextIndexedByShards)
+{
+  // Each worker indexes in its own shard, the shards are merged in the
+  // fulltext index of the archive.
+  const unsigned nbItems = 1000;
+  TempZimFile zimFile("creator_fulltext_shards");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+           .configNbWorkers(4).configIndexing(true, "eng");
+    creator.startZimCreation(zimFile.path());
+    addItems(creator, nbItems);
+    creator.finishZimCreation();
+  }
+  checkItems(zimFile.path(), nbItems);
+
+  zim::Archive archive(zimFile.path());
+  ASSERT_TRUE(archive.hasFulltextIndex());
+  {
+    // All the items are in the merged index.
+    zim::Search search(archive);
+    search.set_query("item").set_range(0, 10);
+    ASSERT_EQ(search.get_matches_estimated(), int(nbItems));
+  }
+  for (unsigned i: {0U, 1U, 2U, 3U, 500U, nbItems-1}) {
+    zim::Search search(archive);
+    search.set_query("Item " + std::to_string(i)).set_range(0, 10);
+    std::vector<std::string> paths;
+    for (auto it = search.begin(); it != search.end(); ++it) {
+      paths.push_back(it.get_url());
+    }
+    ASSERT_NE(std::find(paths.begin(), paths.end(), itemPath(i)), paths.end()) << i;
+  }
+}
+
+TEST(ZimCreator, updateToAddFulltextIndex)
+{
+  const unsigned nbItems = 100;
+  TempZimFile zimFile("creator_no_index");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1);
+    creator.startZimCreation(zimFile.path());
+    addItems(creator, nbItems);
+    creator.finishZimCreation();
+  }
+  TempZimFile indexedFile("creator_index_added");
+  {
+    zim::writer::Creator creator;
+    creator.configIndexing(true, "eng");
+    creator.startZimUpdate(indexedFile.path(), zimFile.path());
+    creator.finishZimCreation();
+  }
+  checkItems(indexedFile.path(), nbItems);
+
+  zim::Archive archive(indexedFile.path());
+  ASSERT_TRUE(archive.hasFulltextIndex());
+  zim::Search search(archive);
+  search.set_query("Item 42").set_range(0, 10);
+  std::vector<std::string> paths;
+  for (auto it = search.begin(); it != search.end(); ++it) {
+    paths.push_back(it.get_url());
+  }
+  ASSERT_NE(std::find(paths.begin(), paths.end(), itemPath(42)), paths.end());
+}
+
+TEST(ZimCreator, updateKeepsFulltextIndex)
+{
+  // Without configIndexing, the fulltext index of the existing archive is
+  // copied as it is. The title index is recreated.
+  const unsigned nbItems = 100;
+  TempZimFile zimFile("creator_indexed");
+  {
+    zim::writer::Creator creator;
+    creator.configCompression(zim::zimcompZstd).configCompressionLevel(1)
+           .configIndexing(true, "eng");
+    creator.startZimCreation(zimFile.path());
+    addItems(creator, nbItems);
+    creator.finishZimCreation();
+  }
+  TempZimFile updatedFile("creator_index_kept");
+  {
+    zim::writer::Creator creator;
+    creator.startZimUpdate(updatedFile.path(), zimFile.path());
+    creator.addItem(zim::writer::StringItem::create("new/0", "text/html", "New item", "new content"));
+    creator.finishZimCreation();
+  }
+
+  zim::Archive archive(updatedFile.path());
+  ASSERT_TRUE(archive.hasFulltextIndex());
+  zim::Search search(archive);
+  search.set_query("Item 42").set_range(0, 10);
+  std::vector<std::string> paths;
+  for (auto it = search.begin(); it != search.end(); ++it) {
+    paths.push_back(it.get_url());
+  }
+  ASSERT_NE(std::find(paths.begin(), paths.end(), itemPath(42)), paths.end());
+  paths = suggestions(archive, "New item");
+  ASSERT_NE(std::find(paths.begin(), paths.end(), "new/0"), paths.end());
+}
+#endif
+
+}  // namespace
@@ -27,10 +27,10 @@ namespace
 
 template<class CompressionInfo>
 std::string
-compress(const std::string& data)
+compress(const std::string& data, int level = -1, unsigned nbThreads = 1)
 {
   zim::Compressor<CompressionInfo> compressor(data.size());
-  compressor.init(const_cast<char*>(data.c_str()));
+  compressor.init(const_cast<char*>(data.c_str()), level, nbThreads);
   compressor.feed(data.c_str(), data.size());
   zim::zsize_t comp_size;
   const auto comp_data = compressor.get_data(&comp_size);
@@ -80,6 +80,29 @@ TYPED_TEST(DecoderStreamReaderTest, justCompressedData) {
   }
 }
 
+TYPED_TEST(DecoderStreamReaderTest, multithreadCompressedData) {
+  typedef typename TestFixture::CompressionInfo CompressionInfo;
+
+  // Enough data to be compressed in several blocks by several threads.
+  // (With the best lzma level, a block would be as big as its 64MB
+  // dictionary.)
+  const int level = 6;
+  const int N = CompressionInfo::mt_block_size(level) / 1024 * 2 + 3;
+  std::string s(1024, '\0');
+  for (int i=0; i<1024; i++)
+    s[i] = char(i*i/7);
+  const std::string compDataStr = compress<CompressionInfo>(s*N, level, 4);
+  auto compData = zim::Buffer::makeBuffer(compDataStr.data(), zim::zsize_t(compDataStr.size()));
+
+  auto compReader = std::make_shared<zim::BufferReader>(compData);
+  zim::DecoderStreamReader<CompressionInfo> dds(compReader);
+  for (int i=0; i<N; i++)
+  {
+    auto decompReader = dds.sub_reader(zim::zsize_t(s.size()));
+    ASSERT_EQ(s, toString(decompReader->get_buffer(zim::offset_t(0), zim::zsize_t(s.size())))) << "i: " << i;
+  }
+}
+
 TYPED_TEST(DecoderStreamReaderTest, compressedDataFollowedByGarbage) {
   typedef typename TestFixture::CompressionInfo CompressionInfo;
 
@@ -22,6 +22,7 @@
 #include <sstream>
 #include <memory>
 #include <stdexcept>
+#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -43,16 +44,21 @@
 namespace
 {
 
-using zim::unittests::TempFile;
-using zim::unittests::write_to_buffer;
+zim::Buffer serialize_to_buffer(const zim::writer::Dirent& dirent)
+{
+  auto buffer = zim::Buffer::makeBuffer(zim::zsize_t(dirent.getDirentSize()));
+  dirent.serialize(const_cast<char*>(buffer.data()));
+  return buffer;
+}
 
 size_t writenDirentSize(const zim::writer::Dirent& dirent)
 {
-  TempFile tmpFile("test_dirent");
-  const auto tmp_fd = tmpFile.fd();
-  dirent.write(tmp_fd);
-  auto size = lseek(tmp_fd, 0, SEEK_END);
-  return size;
+  // Serialize in a larger buffer and let the reader tell the size of the
+  // serialized dirent.
+  std::vector<char> data(dirent.getDirentSize() + 256, 'x');
+  dirent.serialize(data.data());
+  zim::Dirent dirent2(zim::Buffer::makeBuffer(data.data(), zim::zsize_t(data.size())));
+  return dirent2.getDirentSize();
 }
 
 TEST(DirentTest, set_get_data_dirent)
@@ -94,7 +100,7 @@ TEST(DirentTest, read_write_article_dirent)
   ASSERT_EQ(dirent.getBlobNumber().v, 1234U);
   ASSERT_EQ(dirent.getVersion(), 0U);
 
-  auto buffer = write_to_buffer(dirent);
+  auto buffer = serialize_to_buffer(dirent);
   zim::Dirent dirent2(buffer);
 
   ASSERT_TRUE(!dirent2.isRedirect());
@@ -120,7 +126,7 @@ TEST(DirentTest, read_write_article_dirent_unicode)
   ASSERT_EQ(dirent.getClusterNumber().v, 45U);
   ASSERT_EQ(dirent.getBlobNumber().v, 1234U);
 
-  auto buffer = write_to_buffer(dirent);
+  auto buffer = serialize_to_buffer(dirent);
   zim::Dirent dirent2(buffer);
 
   ASSERT_TRUE(!dirent2.isRedirect());
@@ -146,7 +152,7 @@ TEST(DirentTest, read_write_redirect_dirent)
   ASSERT_EQ(dirent.getPath(), "Bar");
   ASSERT_EQ(dirent.getRedirectIndex().v, 321U);
 
-  auto buffer = write_to_buffer(dirent);
+  auto buffer = serialize_to_buffer(dirent);
   zim::Dirent dirent2(buffer);
 
   ASSERT_TRUE(dirent2.isRedirect());
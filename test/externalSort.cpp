@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../src/writer/externalSort.h"
+#include "tools.h"
+
+namespace
+{
+
+struct Record
+{
+  Record() = default;
+  Record(uint32_t key, uint32_t order, std::string payload)
+    : key(key), order(order), payload(payload) {}
+
+  size_t memorySize() const { return sizeof(Record) + payload.size(); }
+  void dump(std::ostream& out) const {
+    zim::writer::dumpValue(out, key);
+    zim::writer::dumpValue(out, order);
+    zim::writer::dumpString(out, payload);
+  }
+  bool load(std::istream& in) {
+    return zim::writer::loadValue(in, key)
+        && zim::writer::loadValue(in, order)
+        && zim::writer::loadString(in, payload);
+  }
+
+  uint32_t key = 0;
+  uint32_t order = 0;
+  std::string payload;
+};
+
+struct KeyOrder {
+  bool operator() (const Record& r1, const Record& r2) const { return r1.key < r2.key; }
+};
+
+typedef zim::writer::ExternalSorter<Record, KeyOrder> Sorter;
+
+void checkSorted(Sorter& sorter, size_t count)
+{
+  sorter.sort();
+  Record previous, record;
+  size_t n = 0;
+  while (sorter.next(record)) {
+    ASSERT_EQ(record.payload, std::to_string(record.key));
+    if (n) {
+      ASSERT_LE(previous.key, record.key);
+      if (previous.key == record.key) {
+        // Stable sort
+        ASSERT_LT(previous.order, record.order);
+      }
+    }
+    previous = record;
+    n++;
+  }
+  ASSERT_EQ(n, count);
+}
+
+TEST(ExternalSortTest, inMemory)
+{
+  zim::unittests::TempFile tmpFile("externalSort");
+  Sorter sorter(tmpFile.path(), 1024*1024);
+  for (uint32_t i=0; i<1000; i++) {
+    auto key = (i*7919) % 101;
+    sorter.add(Record(key, i, std::to_string(key)));
+  }
+  ASSERT_EQ(sorter.size(), 1000U);
+  checkSorted(sorter, 1000);
+}
+
+TEST(ExternalSortTest, severalRuns)
+{
+  zim::unittests::TempFile tmpFile("externalSort");
+  // Small budget: a few records per run and more runs than what is merged
+  // at once.
+  Sorter sorter(tmpFile.path(), 1024);
+  const uint32_t count = 5000;
+  for (uint32_t i=0; i<count; i++) {
+    auto key = (i*7919) % 997;
+    sorter.add(Record(key, i, std::to_string(key)));
+  }
+  checkSorted(sorter, count);
+}
+
+TEST(ExternalSortTest, concurrentRuns)
+{
+  zim::unittests::TempFile tmpFile("externalSort");
+  // The runs are sorted by several threads, they may be written out of
+  // order but the merge stays stable.
+  Sorter sorter(tmpFile.path(), 4096, 4);
+  const uint32_t count = 5000;
+  for (uint32_t i=0; i<count; i++) {
+    auto key = (i*7919) % 997;
+    sorter.add(Record(key, i, std::to_string(key)));
+  }
+  checkSorted(sorter, count);
+}
+
+TEST(ExternalSortTest, empty)
+{
+  zim::unittests::TempFile tmpFile("externalSort");
+  Sorter sorter(tmpFile.path(), 1024);
+  checkSorted(sorter, 0);
+}
+
+}  // namespace
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../src/writer/parallelSort.h"
+
+namespace
+{
+
+typedef std::pair<unsigned, unsigned> KeyOrder;
+
+struct CompareKey {
+  bool operator() (const KeyOrder& a, const KeyOrder& b) const { return a.first < b.first; }
+};
+
+TEST(ParallelSortTest, stableSort)
+{
+  for (unsigned nbThreads: {1U, 2U, 3U, 8U}) {
+    std::vector<KeyOrder> values;
+    const unsigned count = 300000;
+    for (unsigned i=0; i<count; i++) {
+      values.push_back(KeyOrder((i*7919U) % 1009U, i));
+    }
+    zim::writer::parallelStableSort(values.begin(), values.end(), CompareKey(), nbThreads);
+    for (unsigned i=1; i<count; i++) {
+      ASSERT_LE(values[i-1].first, values[i].first);
+      if (values[i-1].first == values[i].first) {
+        ASSERT_LT(values[i-1].second, values[i].second);
+      }
+    }
+  }
+}
+
+}  // namespace
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../src/writer/queue.h"
+
+namespace
+{
+
+TEST(QueueTest, fifo)
+{
+  Queue<int> queue;
+  ASSERT_TRUE(queue.isEmpty());
+
+  queue.pushToQueue(1);
+  queue.pushToQueue(2);
+  queue.pushToQueue(3);
+  ASSERT_EQ(queue.size(), 3U);
+
+  int value;
+  ASSERT_TRUE(queue.getHead(value));
+  ASSERT_EQ(value, 1);
+  ASSERT_TRUE(queue.popFromQueue(value));
+  ASSERT_EQ(value, 1);
+  queue.waitForHead(value);
+  ASSERT_EQ(value, 2);
+  queue.waitAndPopFromQueue(value);
+  ASSERT_EQ(value, 2);
+  queue.waitAndPopFromQueue(value);
+  ASSERT_EQ(value, 3);
+  ASSERT_TRUE(queue.isEmpty());
+  ASSERT_FALSE(queue.popFromQueue(value));
+}
+
+TEST(QueueTest, producersConsumers)
+{
+  // Producers block when the queue is full, consumers block when it is
+  // empty. Everything pushed must be popped exactly once.
+  const int nbProducers = 4;
+  const int nbConsumers = 3;
+  const int nbValues = 1000;
+  Queue<int> queue;
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < nbProducers; ++p) {
+    producers.emplace_back([&queue]() {
+      for (int i = 1; i <= nbValues; ++i) {
+        queue.pushToQueue(i);
+      }
+    });
+  }
+
+  std::vector<long> sums(nbConsumers, 0);
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < nbConsumers; ++c) {
+    consumers.emplace_back([&queue, &sums, c]() {
+      while (true) {
+        int value;
+        queue.waitAndPopFromQueue(value);
+        if (value == 0) {
+          return;
+        }
+        ASSERT_LE(queue.size(), size_t(MAX_QUEUE_SIZE+1));
+        sums[c] += value;
+      }
+    });
+  }
+
+  for (auto& thread: producers) {
+    thread.join();
+  }
+  for (int c = 0; c < nbConsumers; ++c) {
+    queue.pushToQueue(0);
+  }
+  for (auto& thread: consumers) {
+    thread.join();
+  }
+
+  long total = 0;
+  for (auto sum: sums) {
+    total += sum;
+  }
+  ASSERT_EQ(total, long(nbProducers) * nbValues * (nbValues + 1) / 2);
+  ASSERT_TRUE(queue.isEmpty());
+}
+
+}  // namespace
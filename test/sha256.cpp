@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include "../src/sha256.h"
+
+#include "gtest/gtest.h"
+
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace
+{
+
+// Feed `data` by chunks of `chunkSize` bytes.
+std::string sha256(const std::string& data, size_t chunkSize)
+{
+  zim::Sha256 sha;
+  for (size_t offset = 0; offset < data.size(); offset += chunkSize) {
+    sha.update(data.data() + offset, std::min(chunkSize, data.size() - offset));
+  }
+  unsigned char digest[zim::Sha256::DIGEST_SIZE];
+  sha.final(digest);
+  std::ostringstream ss;
+  for (auto c: digest) {
+    ss << std::hex << std::setw(2) << std::setfill('0') << unsigned(c);
+  }
+  return ss.str();
+}
+
+TEST(Sha256, digests)
+{
+  for (size_t chunkSize: {1, 3, 64, 1000}) {
+    EXPECT_EQ(sha256("", chunkSize),
+              "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(sha256("abc", chunkSize),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", chunkSize),
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    EXPECT_EQ(sha256(std::string(1000000, 'a'), chunkSize),
+              "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+  }
+}
+
+}  // namespace
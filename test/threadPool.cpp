@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../src/thread_pool.h"
+
+namespace
+{
+
+TEST(ThreadPoolTest, runTasks)
+{
+  zim::ThreadPool pool(3);
+  ASSERT_EQ(pool.size(), 3U);
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 100; ++i) {
+    results.push_back(pool.submit([i]() { return i*i; }));
+  }
+  for (int i = 0; i < 100; ++i) {
+    pool.wait(results[i]);
+    ASSERT_EQ(results[i].get(), i*i);
+  }
+}
+
+TEST(ThreadPoolTest, nestedTasks)
+{
+  // Each task waits for the tasks it submits. With a single thread, this
+  // only works if the waiting threads run the pending tasks.
+  zim::ThreadPool pool(1);
+  auto outer = pool.submit([&pool]() {
+    std::vector<std::future<int>> inner;
+    for (int i = 0; i < 10; ++i) {
+      inner.push_back(pool.submit([i]() { return i; }));
+    }
+    int sum = 0;
+    for (auto& result: inner) {
+      pool.wait(result);
+      sum += result.get();
+    }
+    return sum;
+  });
+  pool.wait(outer);
+  ASSERT_EQ(outer.get(), 45);
+}
+
+TEST(ThreadPoolTest, exception)
+{
+  zim::ThreadPool pool(2);
+  auto result = pool.submit([]() -> int { throw std::runtime_error("failure"); });
+  pool.wait(result);
+  ASSERT_THROW(result.get(), std::runtime_error);
+}
+
+TEST(ThreadPoolTest, destructorRunsPendingTasks)
+{
+  std::atomic<int> count(0);
+  {
+    zim::ThreadPool pool(2);
+    for (int i = 0; i < 100; ++i) {
+      pool.submit([&count]() { ++count; });
+    }
+  }
+  ASSERT_EQ(count, 100);
+}
+
+}  // namespace
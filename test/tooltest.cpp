@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2026 Matthieu Gautier <mgautier@kymeria.fr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../src/tools.h"
+
+namespace
+{
+
+TEST(Tools, removeAccents)
+{
+  ASSERT_EQ(zim::removeAccents("\xc3\x89l\xc3\xa8ve \xc3\xa0 l'\xc3\xa9" "cole"), "eleve a l'ecole");
+  ASSERT_EQ(zim::removeAccents("Title 42"), "title 42");
+  ASSERT_EQ(zim::removeAccents(""), "");
+}
+
+TEST(Tools, removeAccentsConcurrently)
+{
+  // Each thread uses its own transliterator.
+  const std::string text("Na\xc3\xafve caf\xc3\xa9");
+  std::atomic<unsigned> nbErrors(0);
+  std::vector<std::thread> threads;
+  for (unsigned i=0; i<4; i++) {
+    threads.emplace_back([&]() {
+      for (unsigned k=0; k<1000; k++) {
+        if (zim::removeAccents(text) != "naive cafe") {
+          nbErrors++;
+        }
+      }
+    });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+  ASSERT_EQ(nbErrors, 0U);
+}
+
+}  // namespace